@@ -0,0 +1,314 @@
+/**
+ *  @file export.c
+ *  @brief  Export of the agenda to JSON Lines and iCalendar
+ *
+ */
+
+/*
+ * Main ideas:
+ * All output goes through one fixed-size buffer, flushed only when full, so nothing is allocated per record.
+ * Times and dates are written digit by digit (hm_to_string), no printf formatting in the record loop.
+ * The date is advanced in days format, converting to a calendar date once per day.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "main.h"
+#include "utils.h"
+#include "export.h"
+
+
+#define EXPORT_BUFFER_SIZE 65536        // size of the output buffer in bytes
+#define ICS_LINE_LENGTH 72               // fold iCalendar lines before this many octets (limit is 75)
+
+
+/* Structs */
+typedef struct {
+    /*
+     * Buffered writer for the output stream
+     */
+    FILE *f;
+    size_t length;                      // bytes currently in the buffer
+    int error;                          // 1, if a write to the stream failed
+    char stamp[17];                     // export time in UTC, "yyyymmddThhmmssZ" (iCalendar DTSTAMP)
+    char agenda_id[9];                  // hash of the activities file name, keeps UIDs of different agendas apart
+    const char *tzid;                   // TZ name of the times, empty for floating (local) times
+    char buf[EXPORT_BUFFER_SIZE];
+} Writer;
+
+static Writer writer;                   // one export at a time, keep the buffer out of the stack
+
+
+/* Writer functions */
+static void w_flush(Writer *w){
+
+    if(w->length > 0 && fwrite(w->buf, 1, w->length, w->f) != w->length){
+        w->error = 1;
+    }
+    w->length = 0;
+}
+
+// Make room for n bytes in the buffer
+static char *w_reserve(Writer *w, size_t n){
+
+    if(w->length + n > EXPORT_BUFFER_SIZE){
+        w_flush(w);
+    }
+    return w->buf + w->length;
+}
+
+static void w_str(Writer *w, const char *s){
+
+    size_t n = strlen(s);
+    memcpy(w_reserve(w, n), s, n);
+    w->length += n;
+}
+
+// Write a non-negative number with a fixed number of digits to p
+static void put_digits(char *p, int value, int width){
+
+    for(int i = width - 1; i >= 0; i--){
+        p[i] = (char)('0' + value % 10);
+        value /= 10;
+    }
+}
+
+static void w_digits(Writer *w, int value, int width){
+
+    put_digits(w_reserve(w, width), value, width);
+    w->length += width;
+}
+
+// Write time in "hh:mm" format, or "hhmm00" if compact (iCalendar)
+static void w_time(Writer *w, int t_minutes, int compact){
+
+    if(compact){
+        w_digits(w, t_minutes / 60 * 100 + t_minutes % 60, 4);
+        w_digits(w, 0, 2);
+    }
+    else{
+        minutes_to_str(t_minutes, w_reserve(w, 6));    // writes 5 characters and '\0'
+        w->length += 5;
+    }
+}
+
+// Write date in "yyyy-mm-dd" format, or "yyyymmdd" if compact (iCalendar)
+static void w_date(Writer *w, int year, int month, int day, int compact){
+
+    w_digits(w, year, 4);
+    if(!compact) w_str(w, "-");
+    w_digits(w, month, 2);
+    if(!compact) w_str(w, "-");
+    w_digits(w, day, 2);
+}
+
+static void w_json_string(Writer *w, const char *s){
+
+    static const char hex[] = "0123456789abcdef";
+    char *p = w_reserve(w, 6 * strlen(s) + 2);    // worst case: every character as \u00XX
+
+    *(p++) = '"';
+    for(; *s; s++){
+        unsigned char c = (unsigned char)*s;
+        if(c == '"' || c == '\\'){
+            *(p++) = '\\';
+            *(p++) = (char)c;
+        }
+        else if(c < 0x20){
+            memcpy(p, "\\u00", 4);
+            p[4] = hex[c >> 4];
+            p[5] = hex[c & 0xf];
+            p += 6;
+        }
+        else{
+            *(p++) = (char)c;
+        }
+    }
+    *(p++) = '"';
+
+    w->length = p - w->buf;
+}
+
+// Write the value of an iCalendar TEXT property, folding long lines
+static void w_ics_text(Writer *w, const char *s, int column){
+
+    char *p = w_reserve(w, 4 * strlen(s) + 2);    // worst case: escape and fold every character
+
+    for(; *s; s++){
+        unsigned char c = (unsigned char)*s;
+        // fold, but never inside a UTF-8 sequence
+        if(column >= ICS_LINE_LENGTH && (c & 0xc0) != 0x80){
+            memcpy(p, "\r\n ", 3);
+            p += 3;
+            column = 1;
+        }
+        if(c == ',' || c == ';' || c == '\\'){
+            *(p++) = '\\';
+            column++;
+        }
+        *(p++) = (char)c;
+        column++;
+    }
+
+    w->length = p - w->buf;
+}
+
+// Write the parameter of a date-time property up to its value: ";TZID=[zone]:", or ":" for floating time
+static void w_tzid(Writer *w){
+
+    if(w->tzid[0] != '\0'){
+        w_str(w, ";TZID=");
+        w_str(w, w->tzid);
+    }
+    w_str(w, ":");
+}
+
+
+/* Record functions */
+static void json_record(Writer *w, const Activity *activity, int year, int month, int day, status state){
+
+    w_str(w, "{\"date\":\"");
+    w_date(w, year, month, day, 0);
+    w_str(w, "\",\"start\":\"");
+    w_time(w, activity->start, 0);
+    w_str(w, "\",\"end\":\"");
+    w_time(w, activity->end, 0);
+    w_str(w, "\",\"description\":");
+    w_json_string(w, activity->description);
+    w_str(w, state == done ? ",\"status\":\"done\"}\n" : ",\"status\":\"undone\"}\n");
+}
+
+static void ics_record(Writer *w, const Activity *activity, int date, int year, int month, int day, status state){
+
+    int end_year, end_month, end_day;
+    int end = activity->end + 1;        // activity end is inclusive, DTEND is not
+
+    w_str(w, "BEGIN:VEVENT\r\nUID:");
+    w_date(w, year, month, day, 1);
+    w_str(w, "T");
+    w_time(w, activity->start, 1);
+    w_str(w, "-");
+    w_str(w, w->agenda_id);
+    w_str(w, "@grandmagenda\r\nDTSTAMP:");
+    w_str(w, w->stamp);
+    w_str(w, "\r\nDTSTART");
+    w_tzid(w);
+    w_date(w, year, month, day, 1);
+    w_str(w, "T");
+    w_time(w, activity->start, 1);
+    w_str(w, "\r\nDTEND");
+    w_tzid(w);
+    days_to_date(date + end / MINUTES_PER_DAY, &end_year, &end_month, &end_day);
+    w_date(w, end_year, end_month, end_day, 1);
+    w_str(w, "T");
+    w_time(w, end % MINUTES_PER_DAY, 1);
+    w_str(w, "\r\nSUMMARY:");
+    w_ics_text(w, activity->description, 8);
+    w_str(w, state == done ? "\r\nX-GRANDMAGENDA-STATUS:done\r\nEND:VEVENT\r\n"
+                           : "\r\nX-GRANDMAGENDA-STATUS:undone\r\nEND:VEVENT\r\n");
+}
+
+
+/* Export functions */
+
+// Prepare the parts of the iCalendar records that are the same for the whole export
+static void init_ics(Writer *w, const char *agenda, const char *zone){
+
+    int year, month, day;
+    time_t now = wall_clock(NULL);
+    int seconds = (int)(now % 86400);
+    unsigned long hash = 2166136261u;   // FNV-1a
+
+    // "yyyymmddThhmmssZ"
+    days_to_date((int)(now / 86400), &year, &month, &day);
+    put_digits(w->stamp, year, 4);
+    put_digits(w->stamp + 4, month, 2);
+    put_digits(w->stamp + 6, day, 2);
+    w->stamp[8] = 'T';
+    put_digits(w->stamp + 9, seconds / 3600, 2);
+    put_digits(w->stamp + 11, seconds / 60 % 60, 2);
+    put_digits(w->stamp + 13, seconds % 60, 2);
+    w->stamp[15] = 'Z';
+    w->stamp[16] = '\0';
+    w->tzid = zone != NULL ? zone : "";
+
+    for(; *agenda; agenda++){
+        hash = ((hash ^ (unsigned char)*agenda) * 16777619u) & 0xffffffffu;
+    }
+    snprintf(w->agenda_id, sizeof(w->agenda_id), "%08lx", hash);
+}
+
+int parse_export_format(const char *name, export_format *format){
+
+    if(strcmp(name, "json") == 0){
+        *format = export_json;
+    }
+    else if(strcmp(name, "ics") == 0){
+        *format = export_ics;
+    }
+    else{
+        return 1;
+    }
+
+    return 0;
+}
+
+int parse_export_days(const char *text, int first_day, int *days){
+
+    char *end;
+    long value = strtol(text, &end, 10);
+    long max_days = date_to_days(9999, 12, 31) - first_day + 1;     // dates are written with 4 year digits
+
+    if(end == text || *end != '\0' || value < 1 || value > max_days){
+        return 1;
+    }
+
+    *days = (int)value;
+    return 0;
+}
+
+int export_activities(FILE *f, export_format format, const char *agenda, const char *zone, int first_day, int days){
+
+    Writer *w = &writer;
+    int year, month, day;
+
+    w->f = f;
+    w->length = 0;
+    w->error = 0;
+
+    if(format == export_ics){
+        init_ics(w, agenda, zone);
+        w_str(w, "BEGIN:VCALENDAR\r\nVERSION:2.0\r\nPRODID:-//GrandmAgenda//EN\r\n");
+    }
+
+    // for each day, for each activity
+    for(int d = 0; d < days; d++){
+        int date = first_day + d;
+        days_to_date(date, &year, &month, &day);
+
+        for(int i = 0; i < num_activities; i++){
+            status state = (d == 0) ? activities[i].status : undone;
+
+            if(format == export_json){
+                json_record(w, &activities[i], year, month, day, state);
+            }
+            else{
+                ics_record(w, &activities[i], date, year, month, day, state);
+            }
+        }
+    }
+
+    if(format == export_ics){
+        w_str(w, "END:VCALENDAR\r\n");
+    }
+
+    w_flush(w);
+    if(fflush(f) != 0){
+        w->error = 1;
+    }
+
+    return w->error;
+}
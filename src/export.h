@@ -0,0 +1,52 @@
+/**
+ *  @file export.h
+ *  @brief  Export of the agenda to JSON Lines and iCalendar
+ *
+ */
+
+
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include <stdio.h>
+
+
+/* Enums */
+typedef enum {export_json, export_ics} export_format;     // supported export formats
+
+
+/* Export functions */
+
+/**
+ * @brief  Get the export format from its name
+ * @param name  The format name, "json" or "ics"
+ * @param format  Holds the result
+ * @return  0 for success, 1 for an unknown format
+ */
+extern int parse_export_format(const char *name, export_format *format);
+
+
+/**
+ * @brief  Get the number of days to export from its text
+ * @param text  The number of days, the whole string must be a number
+ * @param first_day  The date of the first exported day in days format (see date_to_days)
+ * @param days  Holds the result
+ * @return  0 for success, 1 if not a number, less than 1, or past the year 9999
+ */
+extern int parse_export_days(const char *text, int first_day, int *days);
+
+
+/**
+ * @brief  Stream the loaded activities to a file, repeated over a number of days
+ * @param f  The output stream
+ * @param format  JSON Lines (one activity per line) or iCalendar
+ * @param agenda  The activities file name, part of the iCalendar UIDs
+ * @param zone  The TZ name of the times (iCalendar TZID), or NULL/"" for floating local times
+ * @param first_day  The date of the first day in days format (see date_to_days)
+ * @param days  Number of days to export. Only the first day carries the current status, the rest are undone.
+ * @return  0 for success, 1 in case writing failed
+ */
+extern int export_activities(FILE *f, export_format format, const char *agenda, const char *zone, int first_day, int days);
+
+
+#endif //EXPORT_H
@@ -0,0 +1,400 @@
+/**
+ *  @file history.c
+ *  @brief  Persisted status history of the activities and completion reports
+ *
+ */
+
+/*
+ * Main ideas:
+ * The history file is plain text, appended once per day, so that a crash never corrupts older days.
+ * A day saved more than once (the program restarted) is merged: a slot is done if any of its saves says so.
+ * For the report, the file is loaded in columns (date, start, name, lateness, done), one array per field.
+ * The aggregation then runs as tight loops over contiguous arrays, instead of walking activity records.
+ * Activity names are replaced by an index to a table of names, so grouping is an array lookup.
+ * The names are found through a hash table, and slots are only searched for merging when a day is saved again.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "main.h"
+#include "history.h"
+
+
+/* Structs */
+typedef struct {
+    /*
+     * The history, one column per field, one row per activity per day
+     */
+    int *date;                      // date in days format
+    int *start;                     // starting time of the slot in minutes format
+    int *name;                      // index to the names table
+    int *lateness;                  // minutes between the end of the activity and marking it done
+    unsigned char *done;            // 1 done, 0 undone
+    int rows;
+    int capacity;
+
+    char (*names)[MAX_DESCRIPTION_LENGTH];     // distinct activity names
+    int num_names;
+    int names_capacity;
+    int *buckets;                   // hash table of the names: index to the names table + 1, 0 if empty
+    int num_buckets;                // a power of 2, at least twice the names
+} History;
+
+typedef struct {
+    /*
+     * Aggregated results for one activity name
+     */
+    int slots;                      // number of times the activity was scheduled
+    int done;                       // number of times it was marked done
+    long lateness;                  // sum of lateness over the done slots
+    int day;                        // the day being accumulated for the streaks
+    int day_done;                   // 1, if all slots of that day are done
+    int streak;                     // current run of consecutive completed days
+    int streak_end;                 // the last day of the current run
+    int longest;                    // longest run of consecutive completed days
+} Summary;
+
+
+/* History functions */
+int save_history(const char *filename, int date){
+
+    FILE *f = fopen(filename, "a");
+    if(f == NULL){
+        return 1;
+    }
+
+    fprintf(f, "day %d\n", date);
+    for(int i = 0; i < num_activities; i++){
+        fprintf(f, "%d %d %d %s\n", activities[i].start, activities[i].end,
+                activities[i].status == done ? activities[i].done_at : -1, activities[i].description);
+    }
+
+    return fclose(f) != 0;
+}
+
+
+/* Loading functions */
+static void free_history(History *h){
+
+    free(h->date);
+    free(h->start);
+    free(h->name);
+    free(h->lateness);
+    free(h->done);
+    free(h->names);
+    free(h->buckets);
+}
+
+// FNV-1a hash of a name
+static unsigned int hash_name(const char *name){
+
+    unsigned int hash = 2166136261u;
+    for(; *name; name++){
+        hash = (hash ^ (unsigned char)*name) * 16777619u;
+    }
+    return hash;
+}
+
+// Double the hash table and reinsert the names. Return 1 if out of memory.
+static int grow_buckets(History *h){
+
+    int num_buckets = h->num_buckets ? 2 * h->num_buckets : 128;
+    int *buckets = calloc(num_buckets, sizeof(int));
+    if(buckets == NULL){
+        return 1;
+    }
+
+    for(int i = 0; i < h->num_names; i++){
+        unsigned int b = hash_name(h->names[i]) & (num_buckets - 1);
+        while(buckets[b] != 0){
+            b = (b + 1) & (num_buckets - 1);
+        }
+        buckets[b] = i + 1;
+    }
+
+    free(h->buckets);
+    h->buckets = buckets;
+    h->num_buckets = num_buckets;
+    return 0;
+}
+
+// Find the index of a name, add it to the table if missing. Return -1 if out of memory.
+static int intern_name(History *h, const char *description){
+
+    if(2 * (h->num_names + 1) > h->num_buckets && grow_buckets(h)){
+        return -1;
+    }
+
+    // Linear probing, up to the first empty bucket
+    unsigned int b = hash_name(description) & (h->num_buckets - 1);
+    for(; h->buckets[b] != 0; b = (b + 1) & (h->num_buckets - 1)){
+        if(strcmp(h->names[h->buckets[b] - 1], description) == 0){
+            return h->buckets[b] - 1;
+        }
+    }
+
+    if(h->num_names == h->names_capacity){
+        int capacity = h->names_capacity ? 2 * h->names_capacity : MAX_ACTIVITIES;
+        void *names = realloc(h->names, capacity * sizeof(*h->names));
+        if(names == NULL){
+            return -1;
+        }
+        h->names = names;
+        h->names_capacity = capacity;
+    }
+
+    strcpy(h->names[h->num_names], description);
+    h->buckets[b] = h->num_names + 1;
+    return h->num_names++;
+}
+
+// Add a row to the columns, or merge it with the same slot in the rows [merge_first, merge_end) of an earlier save of the day.
+// Return 1 if out of memory.
+static int add_row(History *h, int date, int merge_first, int merge_end, const Activity *activity){
+
+    int name = intern_name(h, activity->description);
+    if(name == -1){
+        return 1;
+    }
+    int lateness = activity->status == done ? activity->done_at - activity->end : 0;
+
+    // The slot was already saved today: done if any save says so, at the earliest time
+    for(int r = merge_first; r < merge_end; r++){
+        if(h->start[r] == activity->start && h->name[r] == name){
+            if(activity->status == done && (!h->done[r] || lateness < h->lateness[r])){
+                h->done[r] = 1;
+                h->lateness[r] = lateness;
+            }
+            return 0;
+        }
+    }
+
+    if(h->rows == h->capacity){
+        int capacity = h->capacity ? 2 * h->capacity : 1024;
+        void *p;
+
+        if((p = realloc(h->date, capacity * sizeof(int))) == NULL) return 1;
+        h->date = p;
+        if((p = realloc(h->start, capacity * sizeof(int))) == NULL) return 1;
+        h->start = p;
+        if((p = realloc(h->name, capacity * sizeof(int))) == NULL) return 1;
+        h->name = p;
+        if((p = realloc(h->lateness, capacity * sizeof(int))) == NULL) return 1;
+        h->lateness = p;
+        if((p = realloc(h->done, capacity * sizeof(unsigned char))) == NULL) return 1;
+        h->done = p;
+
+        h->capacity = capacity;
+    }
+
+    h->date[h->rows] = date;
+    h->start[h->rows] = activity->start;
+    h->name[h->rows] = name;
+    h->done[h->rows] = activity->status == done;
+    h->lateness[h->rows] = lateness;
+    h->rows++;
+
+    return 0;
+}
+
+// Read an integer at p. Return the first character after it, or NULL if there is no (reasonably sized) number.
+static char *read_number(char *p, int *value){
+
+    int sign = 1;
+    int n = 0;
+
+    if(*p == '-'){
+        sign = -1;
+        p++;
+    }
+    if(*p < '0' || *p > '9'){
+        return NULL;
+    }
+    for(; *p >= '0' && *p <= '9'; p++){
+        if(n > 99999999){           // minutes and dates are far smaller
+            return NULL;
+        }
+        n = 10 * n + (*p - '0');
+    }
+
+    *value = sign * n;
+    return p;
+}
+
+// Parse "[start] [end] [done at or -1] [description]". Return 1 if the line is invalid.
+static int parse_row(char *string, Activity *activity){
+
+    char *p = string;
+    int done_at;
+
+    if((p = read_number(p, &activity->start)) == NULL || *(p++) != ' '
+       || (p = read_number(p, &activity->end)) == NULL || *(p++) != ' '
+       || (p = read_number(p, &done_at)) == NULL || *p != ' '){
+        return 1;
+    }
+    while(*p == ' '){
+        p++;
+    }
+
+    size_t length = strcspn(p, "\n");
+    if(length > MAX_DESCRIPTION_LENGTH - 1){
+        length = MAX_DESCRIPTION_LENGTH - 1;
+    }
+    memcpy(activity->description, p, length);
+    activity->description[length] = '\0';
+    activity->status = done_at == -1 ? undone : done;
+    activity->done_at = done_at;
+
+    return 0;
+}
+
+static int load_history(const char *filename, History *h){
+
+    char string[MAX_STRING_LENGTH];
+    Activity activity;
+    int date = 0;
+    int day_found = 0;
+    int first_row = 0;              // first row of the current day
+    int merge_end = 0;              // end of the rows of the day saved before, first_row if the day is new
+    int line = 0;
+
+    FILE *f = fopen(filename, "r");
+    if (f == NULL) {
+        fprintf(stderr, "File \"%s\" not found.\n\n", filename);
+        return 1;
+    }
+
+    while (fgets(string, MAX_STRING_LENGTH, f)) {
+        int next_date;
+        char *end;
+        line++;
+
+        // New day
+        if(strncmp(string, "day ", 4) == 0 && (end = read_number(string + 4, &next_date)) != NULL
+           && (*end == '\n' || *end == '\0')){
+            // The same day saved again: keep first_row, so the new block is merged into the older ones
+            if(!day_found || next_date != date){
+                first_row = h->rows;
+            }
+            merge_end = h->rows;
+            date = next_date;
+            day_found = 1;
+            continue;
+        }
+
+        // Activity of the current day
+        if(!day_found || parse_row(string, &activity)){
+            fprintf(stderr, "Invalid history file \"%s\", line %d.\n", filename, line);
+            fclose(f);
+            return 1;
+        }
+
+        if(add_row(h, date, first_row, merge_end, &activity)){
+            fprintf(stderr, "Memory allocation failed!\n");
+            fclose(f);
+            return 1;
+        }
+    }
+
+    fclose(f);
+    return 0;
+}
+
+
+/* Report functions */
+
+// Close the accumulated day of a name and update its streaks
+static void close_day(Summary *s){
+
+    if(s->day_done){
+        s->streak = (s->streak > 0 && s->streak_end == s->day - 1) ? s->streak + 1 : 1;
+        s->streak_end = s->day;
+        if(s->streak > s->longest){
+            s->longest = s->streak;
+        }
+    }
+    else{
+        s->streak = 0;
+    }
+}
+
+static void aggregate(const History *h, Summary *summary){
+
+    const int *date = h->date;
+    const int *name = h->name;
+    const int *lateness = h->lateness;
+    const unsigned char *is_done = h->done;
+    int rows = h->rows;
+
+    // Counters: one pass over the columns
+    for(int r = 0; r < rows; r++){
+        Summary *s = &summary[name[r]];
+        s->slots++;
+        s->done += is_done[r];
+        s->lateness += is_done[r] ? lateness[r] : 0;
+    }
+
+    // Streaks: rows are in date order, a day counts if all its slots of that name are done
+    for(int i = 0; i < h->num_names; i++){
+        summary[i].day = -1;
+    }
+    for(int r = 0; r < rows; r++){
+        Summary *s = &summary[name[r]];
+        if(date[r] != s->day){
+            if(s->day != -1){
+                close_day(s);
+            }
+            s->day = date[r];
+            s->day_done = 1;
+        }
+        s->day_done &= is_done[r];
+    }
+    for(int i = 0; i < h->num_names; i++){
+        close_day(&summary[i]);
+    }
+}
+
+int print_report(FILE *out, const char *filename){
+
+    History h = {0};
+
+    if(load_history(filename, &h)){
+        free_history(&h);
+        return 1;
+    }
+    if(h.rows == 0){
+        fprintf(out, "No history in \"%s\" yet.\n", filename);
+        free_history(&h);
+        return 0;
+    }
+
+    Summary *summary = calloc(h.num_names, sizeof(Summary));
+    if(summary == NULL){
+        fprintf(stderr, "Memory allocation failed!\n");
+        free_history(&h);
+        return 1;
+    }
+    aggregate(&h, summary);
+
+    int last_date = h.date[h.rows - 1];
+    fprintf(out, "%-30s %6s %6s %7s %14s %8s %8s\n", "Activity", "Slots", "Done", "Rate", "Avg lateness", "Longest", "Current");
+    for(int i = 0; i < h.num_names; i++){
+        Summary *s = &summary[i];
+        int current = (s->streak_end == last_date) ? s->streak : 0;    // a streak is current, if it includes the last day
+
+        fprintf(out, "%-30s %6d %6d %6.1f%%", h.names[i], s->slots, s->done, 100.0 * s->done / s->slots);
+        if(s->done > 0){
+            fprintf(out, " %10.1f min", (double)s->lateness / s->done);
+        }
+        else{
+            fprintf(out, " %14s", "-");
+        }
+        fprintf(out, " %8d %8d\n", s->longest, current);
+    }
+
+    free(summary);
+    free_history(&h);
+    return 0;
+}
@@ -0,0 +1,43 @@
+/**
+ *  @file history.h
+ *  @brief  Persisted status history of the activities and completion reports
+ *
+ */
+
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdio.h>
+
+
+/* History functions */
+
+/**
+ * @brief  Append the status of the loaded activities to the history file
+ * @param filename  The history file
+ * @param date  The date of the agenda in days format (see date_to_days)
+ * @return  0 for success, 1 in case the file could not be written
+ *
+ * --------------------------------------------------------------
+ * File format, one block per saved day:
+ *      day [date in days format]
+ *      [start] [end] [done at or -1] [description]
+ *      ...
+ * Times are in minutes format. If the same day is saved again, the blocks are merged by the report:
+ * a slot counts as done if any block says so, at the earliest done time.
+ * --------------------------------------------------------------
+ */
+extern int save_history(const char *filename, int date);
+
+
+/**
+ * @brief  Print completion rate, average lateness and streaks per activity name
+ * @param out  The output stream
+ * @param filename  The history file
+ * @return  0 for success, 1 in case the file is not found or is invalid (the error is printed to stderr)
+ */
+extern int print_report(FILE *out, const char *filename);
+
+
+#endif //HISTORY_H
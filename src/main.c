@@ -10,6 +10,7 @@
  * A queue (linked list) for the printing buffer. Store messages and print them at the defined interval.
  * Use an internal program time notion, which can run faster than the real world.
  * The user can enter whatever, so handle input robustly with checks.
+ * Questions to the user do not wait for the answer: they are sessions, resumed when a yes/no answer arrives.
  */
 
 #include <stdio.h>
@@ -21,26 +22,16 @@
 
 #include "main.h"
 #include "utils.h"
+#include "export.h"
+#include "history.h"
+#include "session.h"
 
 
-#define MAX_STRING_LENGTH 200          // a fixed limit for handled strings
-#define MAX_ACTIVITIES 50                       // maximum number of activities
 #define PRINT_INTERVAL 3                         // printing time interval in secs
 #define MINUTES_DUE 10                           // the minutes to give a notification, before an activity ends
 
 
-/* Enums and structs */
-typedef enum {undone, done} status;     // status of an activity
-typedef struct {
-    /*
-     * Represents an activity
-     */
-    status status;                  // 0 undone, 1 done
-    status start_notification;      // done, if the start notification is printed
-    int start;                      // starting time in minutes format
-    int end;                        // ending time in minutes format
-    char description[100];          // name of the activity
-} Activity;
+/* Structs */
 struct Node{
     /*
      * Represents a node in the messages queue of the printer
@@ -52,14 +43,22 @@ struct Node{
 
 /* Global Variables */
 int speed_factor;               // input from user: how fast the simulated time moves (1 real time, 2 twice, etc.)
+float time_step;                // the system time for one minute of simulation time, in secs
+int resident_zone = CLOCK_ZONE_LOCAL;   // input from user: timezone of the real-world "now"
 int t_simulation;               // the internal simulation time
 clock_t last_t_sim;             // the last system time that t_simulation was advanced
 clock_t last_t_printed = 0;     // the last system time that the program printed something or received input
 
+clock_t (*engine_clock)(void) = clock;                  // the system time source
+int (*engine_date)(void) = resident_today;              // the real-world date source
+FILE *input_stream = NULL;                              // the user input source, NULL for stdin
+void (*printer_output)(const char *message) = print_message;    // where the printer writes its messages
+
 struct Node *front = NULL;      // front and rear element in the printer buffer queue
 struct Node *rear = NULL;
 int num_messages = 0;           // number of messages in the printing queue
 
+char agenda_file[MAX_STRING_LENGTH];    // the activities file, input from user
 Activity activities[MAX_ACTIVITIES];    // activities list
 int num_activities = 0;                 // total number of activities
 int current_activity;                   // index to activities[]
@@ -81,6 +80,7 @@ void display_intro(void){
     printf("Welcome to Grandm(other)Agenda ver.1.2!\n"
                "To check a timeslot, enter time in \"hh:mm\" format or simply type \"now\".\n"
                "I will notify you when it's time to start an activity and 10 minutes before an activity is due.\n"
+               "To save the agenda, type \"export [json|ics] [days]\" (default: today, as JSON Lines).\n"
                "To exit the program, type \"exit\".\n\n"
                "First, let's initialize the grandmother world time.\n");
 }
@@ -89,7 +89,7 @@ void display_intro(void){
 /* Input functions */
 void user_input(char* input){
 
-    fgets(input, MAX_STRING_LENGTH, stdin);
+    fgets(input, MAX_STRING_LENGTH, input_stream != NULL ? input_stream : stdin);
     strtok(input, "\n");                // Strip newline from string
 
     pthread_mutex_lock(&mutex_print_clock);  // Reset the printer clock
@@ -107,6 +107,10 @@ int process_input(char* input){
     if(strcmp(input, "exit") == 0){
         ret = 1;
     }
+    // Export agenda
+    else if(strncmp(input, "export", 6) == 0 && (input[6] == '\0' || input[6] == ' ')){
+        ret = 3;
+    }
     // Input: now --> Return current simulation time in string format
     else if(strcmp(input, "now") == 0){
         pthread_mutex_lock(&mutex_t_simulation);
@@ -166,6 +170,7 @@ int load_activities(const char *filename){
 
         activities[num_activities].status = undone;
         activities[num_activities].start_notification = undone;
+        activities[num_activities].done_at = -1;
 
         char *token = strtok(string, " "); // get start hour
         hh_start = atoi(token);
@@ -211,10 +216,32 @@ int find_activity(char *t_string){
     return ret;
 }
 
-void print_activity(int index){
+void ask_done(Session *session){
+
+    send_to_printer("Activity \"%s\" is not done yet.\nShould I check this activity as done? (yes/no)\n", activities[session->activity].description);
+}
+
+int resume_done(Session *session, const char *answer){
+
+    int index = session->activity;
+
+    if(strcmp(answer, "yes") == 0){
+        send_to_printer("Activity \"%s\" marked as done! \n", activities[index].description);
+        pthread_mutex_lock(&mutex_t_simulation);
+        activities[index].done_at = t_simulation;
+        pthread_mutex_unlock(&mutex_t_simulation);
+        activities[index].status = done;
+    }
+    else{
+        send_to_printer( "Status of \"%s\" remained: undone. \n", activities[index].description);
+    }
+
+    return 1;   // one answer is enough
+}
+
+void print_activity(int index, int owner){
 
     // Get start and end time in string format
-    char temp_string[MAX_STRING_LENGTH];
     char start_string[6];
     char end_string[6];
     minutes_to_str(activities[index].start, start_string);
@@ -224,16 +251,19 @@ void print_activity(int index){
 
     switch(activities[index].status){
         case undone:
-            send_to_printer("Activity \"%s\" is not done yet.\nShould I check this activity as done? (yes/no)\n", activities[index].description);
-
-            user_input(temp_string);
-
-            if(strncmp(temp_string, "yes", 3 * sizeof(char)) == 0){
-                send_to_printer("Activity \"%s\" marked as done! \n", activities[index].description);
-                activities[index].status = done;
+            // Ask, the answer is handled whenever it arrives (see handle_query)
+            if(session_pending(owner, index)){
+                send_to_printer("Activity \"%s\" is not done yet. I already asked, please answer with yes or no.\n", activities[index].description);
+                break;
             }
-            else{
-                send_to_printer( "Status of \"%s\" remained: undone. \n", activities[index].description);
+            switch(open_session(owner, ask_done, resume_done, index)){
+                case 1:     // no space
+                    send_to_printer("Activity \"%s\" is not done yet. Too many open questions, please answer the previous ones first.\n", activities[index].description);
+                    break;
+                case 2:     // queued, name the question to answer first
+                    send_to_printer("Activity \"%s\" is not done yet. I will ask after you answer about \"%s\" (yes/no).\n",
+                                    activities[index].description, activities[session_waiting(owner)].description);
+                    break;
             }
             break;
         case done:
@@ -242,6 +272,50 @@ void print_activity(int index){
 }
 
 
+void export_agenda(char *input){
+
+    export_format format = export_json;
+    int days = 1;
+    int date = engine_date();
+    char *name = strtok(input + 6, " ");    // skip "export"
+    char *number = name ? strtok(NULL, " ") : NULL;
+
+    if((name != NULL && parse_export_format(name, &format))
+       || (number != NULL && parse_export_days(number, date, &days))
+       || strtok(NULL, " ") != NULL){
+        send_to_printer("Invalid input: type \"export [json|ics] [days]\". Please try again.\n");
+        return;
+    }
+
+    char filename[MAX_STRING_LENGTH + 6];
+    snprintf(filename, sizeof(filename), format == export_ics ? "%s.ics" : "%s.jsonl", agenda_file);
+
+    FILE *f = fopen(filename, "w");
+    if(f == NULL){
+        send_to_printer("Could not open \"%s\" for writing.\n", filename);
+        return;
+    }
+
+    int failed = export_activities(f, format, agenda_file, clock_zone_name(resident_zone), date, days);
+    if(fclose(f) != 0 || failed){
+        send_to_printer("Export to \"%s\" failed.\n", filename);
+        return;
+    }
+
+    send_to_printer("Agenda exported to \"%s\".\n", filename);
+}
+
+void save_status(void){
+
+    char filename[MAX_STRING_LENGTH + 8];
+    snprintf(filename, sizeof(filename), "%s.history", agenda_file);
+
+    if(save_history(filename, engine_date())){
+        printf("Could not save the status history to \"%s\".\n", filename);
+    }
+}
+
+
 /* Printer functions */
 
 void send_to_printer(const char *in_string, ...){
@@ -349,7 +423,7 @@ void print_next(void){
 
     if (num_messages > 0)
     {
-        printf("%s", front->message);  // Print the content of front
+        printer_output(front->message);  // Print the content of front
         front = front->link;                    // Move the front pointer
         free(node);                             // Free previous front
         num_messages--;
@@ -358,97 +432,264 @@ void print_next(void){
     pthread_mutex_unlock(&mutex_printer);
 }
 
+void print_message(const char *message){
+
+    printf("%s", message);
+}
+
+void clear_printer(void){
+
+    pthread_mutex_lock(&mutex_printer);
+
+    while (num_messages > 0)
+    {
+        struct Node *node = front;
+        front = front->link;
+        free(node);
+        num_messages--;
+    }
+
+    pthread_mutex_unlock(&mutex_printer);
+}
+
 
 /* Time functions */
+int resident_today(void){
+
+    return today_in_days(resident_zone);
+}
+
 void reset_print_clock(){
-    last_t_printed = clock();
+    last_t_printed = engine_clock();
+}
+
+
+/* Engine functions */
+void init_simulation(const char *t_string){
+
+    time_step = 60 / (float)speed_factor;    // calculate once to save on computations
+
+    clear_printer();
+    clear_sessions();
+    pthread_mutex_lock(&mutex_print_clock);
+    reset_print_clock();
+    pthread_mutex_unlock(&mutex_print_clock);
+
+    pthread_mutex_lock(&mutex_t_simulation);
+    t_simulation = str_to_minutes(t_string);    // initialize simulation time
+    last_t_sim = engine_clock();
+    pthread_mutex_unlock(&mutex_t_simulation);
+
+    // Find current activity
+    current_activity = find_activity((char *)t_string);
+    activity_starts = activities[current_activity].start;
+    activity_ends = activities[current_activity].end;
+}
+
+int engine_step(void){
+
+    clock_t now_clock;       // for execution time
+
+    /* Advance Simulation Time */
+    pthread_mutex_lock(&mutex_t_simulation);
+    now_clock = engine_clock();
+    if((float)(now_clock - last_t_sim) / CLOCKS_PER_SEC >= time_step) {
+        last_t_sim = now_clock;
+        t_simulation++; // increase the simulation time (minutes format)
+    }
+    pthread_mutex_unlock(&mutex_t_simulation);
+
+
+    /* Print next available message */
+    // atomic execution, for last_t_printed to be safe
+    pthread_mutex_lock(&mutex_print_clock);
+    now_clock = engine_clock();
+    if((float)(now_clock - last_t_printed) / CLOCKS_PER_SEC >= PRINT_INTERVAL){
+        print_next();
+        reset_print_clock();  // reset clock when something is printed
+    }
+    pthread_mutex_unlock(&mutex_print_clock);
+
+
+    /* Check start and end notification of activities */
+
+    // If start of current activity reached
+    if(t_simulation == activity_starts){
+        if(activities[current_activity].start_notification == undone){
+            send_to_printer("Activity \"%s\" starts now!\n", activities[current_activity].description);
+            activities[current_activity].start_notification = done;
+        }
+    }
+    // The current activity ends soon
+    else if((t_simulation + MINUTES_DUE) >= activity_ends){
+        if(activities[current_activity].status == undone){
+            send_to_printer("Activity \"%s\" ends in less than %d minutes!\n", activities[current_activity].description, MINUTES_DUE);
+        }
+
+        // The next activity becomes the current activity
+        current_activity++;
+
+        // If there is no next activity, the day is over
+        if(current_activity >= num_activities){
+            return 1;
+        }
+
+        // Store new activity starting and finishing times
+        activity_starts = activities[current_activity].start;
+        activity_ends = activities[current_activity].end;
+    }
+
+    return 0;
+}
+
+int handle_query(char *input, int owner){
+
+    static int i_activity;             // activity index
+    char message[MAX_STRING_LENGTH];
+
+    // An answer to a waiting question
+    if(strcmp(input, "yes") == 0 || strcmp(input, "no") == 0){
+        if(resume_session(owner, input) == 0)
+            return 0;
+    }
+
+    // Handle user input
+    switch(process_input(input)){
+        case 0:     // valid time input in string
+            break;
+        case 2: // now
+            snprintf(message, sizeof(message), "%s\n", input);
+            printer_output(message); // print time for convenience
+            break;
+        case 3:     // export
+            export_agenda(input);
+            return 0;
+        case 1:     // the user wants to exit
+            return 1;
+        case -1:    // invalid input entered
+        default:
+            return 0;
+    }
+
+    // String contains valid time in string format "%d%d:%d%d"
+    i_activity = find_activity(input);
+    if(i_activity == -1){
+        // Something is wrong with the activities file
+        printf("Activity not found. There should be no free slot in the activities file!Exiting.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Activity found
+    print_activity(i_activity, owner);
+
+    return 0;
 }
 
 
 /* Thread functions */
 void *thread_printer(void *arg)
 {
-    static clock_t now_clock;       // for execution time
-    float time_step = 60 / (float)speed_factor;    // calculate once to save on computations
+    while(engine_step() == 0)
+        ;
 
-    while(1){
+    // End of day: the printer stops here, so print directly
+    if(activities[num_activities-1].status == undone){
+        printf("Activity \"%s\" ends in less than %d minutes!\n", activities[num_activities-1].description, MINUTES_DUE);
+    }
+    printf("End of day reached! Exiting.\n");
+    save_status();
+    exit(EXIT_SUCCESS);
 
-        /* Advance Simulation Time */
-        pthread_mutex_lock(&mutex_t_simulation);
-        now_clock = clock();
-        if((float)(now_clock - last_t_sim) / CLOCKS_PER_SEC >= time_step) {
-            last_t_sim = now_clock;
-            t_simulation++; // increase the simulation time (minutes format)
-        }
-        pthread_mutex_unlock(&mutex_t_simulation);
+    return NULL;
+}
+
+
+/* Mode functions */
+int export_mode(int argc, char *argv[]){
 
+    export_format format;
+    int days = 1;
+    int zone = CLOCK_ZONE_LOCAL;
+    int first_day;
 
-        /* Print next available message */
-        // atomic execution, for last_t_printed to be safe
-        pthread_mutex_lock(&mutex_print_clock);
-        now_clock = clock();
-        if((float)(now_clock - last_t_printed) / CLOCKS_PER_SEC >= PRINT_INTERVAL){
-            print_next();
-            reset_print_clock();  // reset clock when something is printed
+    if(argc < 4 || argc > 6 || parse_export_format(argv[3], &format)){
+        printf("Please supply the following arguments:\n"
+               " export 1.full text filepath 2.format (json or ics) 3.number of days (optional)"
+               " 4.timezone (optional, e.g. Europe/Athens)\n");
+        return EXIT_FAILURE;
+    }
+    if(argc == 6){
+        zone = clock_zone(argv[5]);
+        if(zone == -1){
+            printf("Invalid timezone. Exiting.\n");
+            return EXIT_FAILURE;
         }
-        pthread_mutex_unlock(&mutex_print_clock);
+    }
+    first_day = today_in_days(zone);
+    if(argc >= 5 && parse_export_days(argv[4], first_day, &days)){
+        printf("Invalid number of days. Exiting.\n");
+        return EXIT_FAILURE;
+    }
 
+    if(load_activities(argv[2]))
+        return EXIT_FAILURE;
 
-        /* Check start and end notification of activities */
+    // Stream to stdout, so that the output can be piped to other tools
+    if(export_activities(stdout, format, argv[2], clock_zone_name(zone), first_day, days)){
+        fprintf(stderr, "Export failed.\n");
+        return EXIT_FAILURE;
+    }
 
-        // If start of current activity reached
-        if(t_simulation == activity_starts){
-            if(activities[current_activity].start_notification == undone){
-                send_to_printer("Activity \"%s\" starts now!\n", activities[current_activity].description);
-                activities[current_activity].start_notification = done;
-            }
-        }
-        // The current activity ends soon
-        else if((t_simulation + MINUTES_DUE) >= activity_ends){
-            if(activities[current_activity].status == undone){
-                send_to_printer("Activity \"%s\" ends in less than %d minutes!\n", activities[current_activity].description, MINUTES_DUE);
-            }
+    return EXIT_SUCCESS;
+}
 
-            // The next activity becomes the current activity
-            current_activity++;
 
-            // If there is no next activity, exit
-            if(current_activity >= num_activities){
-                if(activities[current_activity].status == undone){
-                    printf("Activity \"%s\" ends in less than %d minutes!\n", activities[current_activity-1].description, MINUTES_DUE);
-                }
-                printf("End of day reached! Exiting.\n");
-                exit(EXIT_SUCCESS);
-            }
+int report_mode(int argc, char *argv[]){
 
-            // Store new activity starting and finishing times
-            activity_starts = activities[current_activity].start;
-            activity_ends = activities[current_activity].end;
+    char filename[MAX_STRING_LENGTH + 8];
 
-        }
+    if(argc != 3){
+        printf("Please supply the following arguments:\n"
+               " report 1.full text filepath\n");
+        return EXIT_FAILURE;
     }
+    snprintf(filename, sizeof(filename), "%s.history", argv[2]);
 
-    return NULL;
+    return print_report(stdout, filename) ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
 
+#ifndef GRANDMAGENDA_NO_MAIN
 int main(int argc, char *argv[]){
 
     char string[MAX_STRING_LENGTH];    // for user input
-    static int i_activity;             // activity index
 
     /* Command line arguments parsing */
-    if( argc != 3 ) {
+    if( argc >= 2 && strcmp(argv[1], "export") == 0 ) {
+        exit(export_mode(argc, argv));
+    }
+    if( argc >= 2 && strcmp(argv[1], "report") == 0 ) {
+        exit(report_mode(argc, argv));
+    }
+    if( argc != 3 && argc != 4 ) {
         printf("Please supply the following arguments:\n"
-               " 1.full text filepath 2.time_speed_factor\n");
+               " 1.full text filepath 2.time_speed_factor 3.timezone (optional, e.g. Europe/Athens)\n");
         exit(EXIT_FAILURE);
     }
     strcpy(string, argv[1]);
+    strcpy(agenda_file, argv[1]);
     speed_factor = atoi(argv[2]);
     if(speed_factor < 1){
         printf("Invalid speed factor. Exiting.\n");
         exit(EXIT_FAILURE);
     }
+    if( argc == 4 ) {
+        resident_zone = clock_zone(argv[3]);
+        if(resident_zone == -1){
+            printf("Invalid timezone. Exiting.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
 
 
     /* Initialization */
@@ -464,17 +705,11 @@ int main(int argc, char *argv[]){
         case 0:     // valid time input in string
             break;
         default:    // in any other case, use real world NOW
-            now_in_string(string);
+            now_in_string(string, resident_zone);
             break;
     }
     printf("Initialized to %s\n", string);
-    t_simulation = str_to_minutes(string);    // initialize simulation time
-    last_t_sim = 0;
-
-    // Find current activity
-    current_activity = find_activity(string);
-    activity_starts = activities[current_activity].start;
-    activity_ends = activities[current_activity].end;
+    init_simulation(string);
 
 
     /* Launch thread for printing messages and checking activity notifications */
@@ -487,31 +722,13 @@ int main(int argc, char *argv[]){
         // Read user input
         user_input(string);
 
-        // Handle user input
-        switch(process_input(string)){
-            case 0:     // valid time input in string
-                break;
-            case 2: // now
-                printf("%s\n", string); // print time for convenience
-                break;
-            case 1:     // the user wants to exit
-                exit(EXIT_SUCCESS);
-            case -1:    // invalid input entered
-            default:
-                continue;
+        // Handle user input, until the user wants to exit
+        if(handle_query(string, SESSION_OWNER_CONSOLE)){
+            save_status();
+            exit(EXIT_SUCCESS);
         }
-
-        // String contains valid time in string format "%d%d:%d%d"
-        i_activity = find_activity(string);
-        if(i_activity == -1){
-            // Something is wrong with the activities file
-            printf("Activity not found. There should be no free slot in the activities file!Exiting.\n");
-            exit(EXIT_FAILURE);
-        }
-
-        // Activity found
-        print_activity(i_activity);
     }
 
     return 0;
 }
+#endif //GRANDMAGENDA_NO_MAIN
@@ -7,6 +7,45 @@
 #ifndef GRANDMAGENDA_H
 #define GRANDMAGENDA_H
 
+#include <stdio.h>
+#include <time.h>
+
+#include "session.h"
+
+
+#define MAX_STRING_LENGTH 200          // a fixed limit for handled strings
+#define MAX_ACTIVITIES 50                       // maximum number of activities
+#define MAX_DESCRIPTION_LENGTH 100     // maximum length of an activity name
+
+
+/* Enums and structs */
+typedef enum {undone, done} status;     // status of an activity
+typedef struct {
+    /*
+     * Represents an activity
+     */
+    status status;                  // 0 undone, 1 done
+    status start_notification;      // done, if the start notification is printed
+    int start;                      // starting time in minutes format
+    int end;                        // ending time in minutes format
+    int done_at;                    // simulation time the activity was marked done, in minutes format
+    char description[MAX_DESCRIPTION_LENGTH];          // name of the activity
+} Activity;
+
+
+/* Global Variables */
+extern Activity activities[MAX_ACTIVITIES];     // activities list
+extern int num_activities;                      // total number of activities
+extern int speed_factor;                        // how fast the simulated time moves (1 real time, 2 twice, etc.)
+extern int t_simulation;                        // the internal simulation time
+extern char agenda_file[MAX_STRING_LENGTH];     // the activities file, also the base name of its .history and .jsonl
+
+// Engine dependencies, replaceable for testing
+extern clock_t (*engine_clock)(void);                   // the system time source, clock() by default
+extern int (*engine_date)(void);                        // the real-world date source, resident_today by default
+extern FILE *input_stream;                              // the user input source, NULL for stdin
+extern void (*printer_output)(const char *message);     // where the printer writes, print_message by default
+
 
 /**
  * @brief  DIsplay intro message
@@ -25,10 +64,18 @@ extern void user_input(char* input);
  * @brief  Process user input
  * @param input  A string of arbitrary length containing user input, stripped of \n in its end
  *                             When return:  Contains valid time input or invalid input, as interpreted by the returned value
- * @return  -1 invalid input, 0 valid time input, 1 exit program, 2 valid now
+ * @return  -1 invalid input, 0 valid time input, 1 exit program, 2 valid now, 3 export
  */
 extern int process_input(char* input);
 
+/**
+ * @brief  Handle a line of user input: an answer to a question, a time query, "now", "export" or "exit"
+ * @param input  A string containing user input, stripped of \n in its end
+ * @param owner  Who typed it, e.g. SESSION_OWNER_CONSOLE: answers only go to the questions asked to them
+ * @return  1 if the user wants to exit, 0 otherwise
+ */
+extern int handle_query(char *input, int owner);
+
 
 /* Activity functions */
 
@@ -48,9 +95,36 @@ extern int find_activity(char *time_string);
 
 /**
  * @brief  Print activity details. In case an activity is not done, ask for an update.
+ *         The question does not wait for the answer: it opens a session, resumed by handle_query.
  * @param index  The index of the activity in the array activities
+ * @param owner  Who asked, the question goes to them
  */
-extern void print_activity(int index);
+extern void print_activity(int index, int owner);
+
+/**
+ * @brief  Session question: ask if the activity should be checked as done
+ * @param session  The session, holds the activity index
+ */
+extern void ask_done(Session *session);
+
+/**
+ * @brief  Session continuation: mark the activity done on "yes", leave it undone otherwise
+ * @param session  The session, holds the activity index
+ * @param answer  The answer of the user
+ * @return  1, the session is finished
+ */
+extern int resume_done(Session *session, const char *answer);
+
+/**
+ * @brief  Export the activities, to the activities file path + ".jsonl" or ".ics"
+ * @param input  The command: "export [json|ics] [days]", by default one day (today, with its status) as JSON Lines
+ */
+extern void export_agenda(char *input);
+
+/**
+ * @brief  Append the status of today's activities to the history file (activities file path + ".history")
+ */
+extern void save_status(void);
 
 
 /* Printer functions */
@@ -83,14 +157,65 @@ extern void send_to_printer(const char *in_string, ...);
  */
 extern void print_next(void);
 
+/**
+ * @brief   Default printer output: write the message to stdout
+ * @param message  The message to be printed
+ */
+extern void print_message(const char *message);
+
+/**
+ * @brief   Drop all messages in the printer buffer
+ */
+extern void clear_printer(void);
+
+
+/* Mode functions */
+
+/**
+ * @brief  Command line export mode: stream the activities to stdout
+ * @param argc  Number of command line arguments
+ * @param argv  "export", activities file, format (json or ics), optionally the number of days and the timezone
+ * @return  EXIT_SUCCESS or EXIT_FAILURE
+ */
+extern int export_mode(int argc, char *argv[]);
+
+/**
+ * @brief  Command line report mode: print completion statistics from the history file
+ * @param argc  Number of command line arguments
+ * @param argv  "report" and the activities file
+ * @return  EXIT_SUCCESS or EXIT_FAILURE
+ */
+extern int report_mode(int argc, char *argv[]);
+
 
 /* Time functions */
 
+/**
+ * @brief  Default date source: the real-world date in the timezone of the resident
+ * @return  The date in days format
+ */
+extern int resident_today(void);
+
 /**
  * @brief  Resets the global printer clock
  */
 extern void reset_print_clock();
 
+/* Engine functions */
+
+/**
+ * @brief  Initialize the simulation time, the current activity and the printer, for the loaded activities
+ * @param t_string  The initial simulation time in string format
+ */
+extern void init_simulation(const char *t_string);
+
+/**
+ * @brief  One iteration of the engine: advance the simulation time, print, issue activity notifications
+ * @return  1 if the end of the day is reached, 0 otherwise
+ */
+extern int engine_step(void);
+
+
 /* Thread functions */
 
 /**
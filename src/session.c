@@ -0,0 +1,124 @@
+/**
+ *  @file session.c
+ *  @brief  Interactive sessions: questions waiting for an answer, without blocking the engine
+ *
+ */
+
+/*
+ * Main ideas:
+ * A question does not wait for its answer: it is stored as a session (continuation + state) and the caller returns.
+ * Sessions wait in a fixed-size array, in the order they were opened, so memory is bounded and nothing is allocated.
+ * Each session belongs to the one who was asked (its owner), and only the owner's answers resume it.
+ * An owner answers its questions in the order they were opened: only the oldest one is asked, the rest wait for it.
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include "session.h"
+
+
+/* Global Variables */
+static Session sessions[MAX_SESSIONS];  // waiting sessions, oldest first
+static int num_sessions = 0;            // number of waiting sessions
+
+static pthread_mutex_t mutex_sessions = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* Session functions */
+
+// Index of the oldest session of an owner, -1 if none. Call with mutex_sessions locked.
+static int oldest_session(int owner){
+
+    for(int i = 0; i < num_sessions; i++){
+        if(sessions[i].owner == owner){
+            return i;
+        }
+    }
+    return -1;
+}
+
+int open_session(int owner, void (*ask)(Session *), int (*resume)(Session *, const char *), int activity){
+
+    pthread_mutex_lock(&mutex_sessions);
+
+    if(num_sessions == MAX_SESSIONS){
+        pthread_mutex_unlock(&mutex_sessions);
+        return 1;
+    }
+
+    // Ask only if the owner has no older question to answer first
+    int queued = oldest_session(owner) != -1;
+
+    Session *session = &sessions[num_sessions++];
+    session->owner = owner;
+    session->ask = ask;
+    session->resume = resume;
+    session->activity = activity;
+
+    if(!queued){
+        session->ask(session);
+    }
+
+    pthread_mutex_unlock(&mutex_sessions);
+    return queued ? 2 : 0;
+}
+
+int session_pending(int owner, int activity){
+
+    int ret = 0;
+
+    pthread_mutex_lock(&mutex_sessions);
+    for(int i = 0; i < num_sessions; i++){
+        if(sessions[i].owner == owner && sessions[i].activity == activity){
+            ret = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&mutex_sessions);
+
+    return ret;
+}
+
+int session_waiting(int owner){
+
+    pthread_mutex_lock(&mutex_sessions);
+    int i = oldest_session(owner);
+    int activity = i != -1 ? sessions[i].activity : -1;
+    pthread_mutex_unlock(&mutex_sessions);
+
+    return activity;
+}
+
+int resume_session(int owner, const char *answer){
+
+    pthread_mutex_lock(&mutex_sessions);
+
+    int i = oldest_session(owner);
+    if(i == -1){
+        pthread_mutex_unlock(&mutex_sessions);
+        return 1;
+    }
+
+    // Resume the oldest session of the owner, remove it if finished
+    if(sessions[i].resume(&sessions[i], answer)){
+        num_sessions--;
+        memmove(&sessions[i], &sessions[i + 1], (num_sessions - i) * sizeof(Session));
+
+        // Ask the question of the owner's next one
+        int next = oldest_session(owner);
+        if(next != -1){
+            sessions[next].ask(&sessions[next]);
+        }
+    }
+
+    pthread_mutex_unlock(&mutex_sessions);
+    return 0;
+}
+
+void clear_sessions(void){
+
+    pthread_mutex_lock(&mutex_sessions);
+    num_sessions = 0;
+    pthread_mutex_unlock(&mutex_sessions);
+}
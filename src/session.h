@@ -0,0 +1,75 @@
+/**
+ *  @file session.h
+ *  @brief  Interactive sessions: questions waiting for an answer, without blocking the engine
+ *
+ */
+
+
+#ifndef SESSION_H
+#define SESSION_H
+
+
+#define MAX_SESSIONS 16                 // maximum number of questions waiting for an answer
+#define SESSION_OWNER_CONSOLE 0         // the user at the terminal, other owners are other clients (e.g. sockets)
+
+
+/* Structs */
+typedef struct Session Session;
+struct Session {
+    /*
+     * Represents a question waiting for an answer. Its state is kept here instead of on a stack,
+     * so that it can be resumed whenever the answer arrives.
+     */
+    int owner;                                              // who was asked, only the owner's answers resume the session
+    void (*ask)(Session *session);                          // print the question
+    int (*resume)(Session *session, const char *answer);    // handle the answer, return 1 when finished, 0 to wait for another one
+    int activity;                                           // index to activities[]
+};
+
+
+/* Session functions */
+
+/**
+ * @brief  Open a session, and ask its question if it is the next one its owner has to answer
+ * @param owner  Who is asked, e.g. SESSION_OWNER_CONSOLE
+ * @param ask  Prints the question, when the session becomes the next to be answered by its owner
+ * @param resume  Handles the answer
+ * @param activity  The activity the question is about
+ * @return  0 if asked, 1 in case MAX_SESSIONS are already waiting, 2 if queued behind an older question of the owner
+ */
+extern int open_session(int owner, void (*ask)(Session *), int (*resume)(Session *, const char *), int activity);
+
+
+/**
+ * @brief  Check if a session of an owner about an activity is waiting for an answer
+ * @param owner  Who was asked
+ * @param activity  The index of the activity
+ * @return  1 if waiting, 0 otherwise
+ */
+extern int session_pending(int owner, int activity);
+
+
+/**
+ * @brief  Return the activity of the question an owner has to answer next
+ * @param owner  Who was asked
+ * @return  The index of the activity, -1 if no session of the owner is waiting
+ */
+extern int session_waiting(int owner);
+
+
+/**
+ * @brief  Pass an answer to the oldest waiting session of its owner, then ask the question of the owner's next one
+ * @param owner  Who answered
+ * @param answer  The answer
+ * @return  0 for success, 1 in case no session of the owner is waiting
+ */
+extern int resume_session(int owner, const char *answer);
+
+
+/**
+ * @brief  Drop all waiting sessions
+ */
+extern void clear_sessions(void);
+
+
+#endif //SESSION_H
@@ -5,13 +5,45 @@
  */ 
 
 
+#define _DEFAULT_SOURCE                 // localtime_r, setenv, strdup and tm_gmtoff
+
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <limits.h>
+#include <sys/stat.h>
 
 #include "utils.h"
 
 
+#define MAX_ZONE_NAME_LENGTH 64
+#define ZONEINFO_DIR "/usr/share/zoneinfo"     // default location of the timezone files
+#define OFFSET_BITS 12                  // UTC offsets are in [-720,840] minutes
+#define OFFSET_BIAS 2048
+#define SPAN_BITS 20                    // minutes an offset is valid for, at most ZONE_HORIZON
+#define ZONE_HORIZON (365 * MINUTES_PER_DAY)    // look this far ahead for the next offset change
+
+
+/* Structs */
+typedef struct {
+    /*
+     * Represents a timezone of the real-world clock
+     */
+    char name[MAX_ZONE_NAME_LENGTH];    // TZ name, empty for the local timezone
+    _Atomic long long cache;            // the UTC offset and the epoch minutes it is valid in (see pack_offset)
+} ClockZone;
+
+
+/* Global Variables */
+time_t (*wall_clock)(time_t *) = time;
+static ClockZone zones[MAX_CLOCK_ZONES];        // zones[CLOCK_ZONE_LOCAL] is the local timezone
+static atomic_int num_zones = 1;
+static pthread_mutex_t mutex_clock = PTHREAD_MUTEX_INITIALIZER;     // localtime_r and the TZ variable
+
+
 /* Utility functions */
 void underscore_to_space(char *s) {
   
@@ -23,13 +55,14 @@ void underscore_to_space(char *s) {
 }
 
 void hm_to_string(char* time_string, int hh, int mm){
-  
-    int h1 = hh / 10;
-    int h2 = hh % 10;
-    int m1 = mm / 10;
-    int m2 = mm % 10;
 
-    sprintf(time_string, "%d%d:%d%d", h1, h2, m1, m2);
+    // Write the digits directly, this is called for every exported record
+    time_string[0] = (char)('0' + hh / 10);
+    time_string[1] = (char)('0' + hh % 10);
+    time_string[2] = ':';
+    time_string[3] = (char)('0' + mm / 10);
+    time_string[4] = (char)('0' + mm % 10);
+    time_string[5] = '\0';
 }
 
 int str_to_hm(const char *time_string, int *hh, int *mm){
@@ -66,9 +99,230 @@ int str_to_minutes(const char *t_string){
     return hm_to_minutes(hh, mm);
 }
 
-void now_in_string(char *time_string){
+int date_to_days(int year, int month, int day){
+
+    // Days since 1970-01-01 in the proleptic Gregorian calendar (civil calendar algorithm)
+    year -= month <= 2;
+    int era = (year >= 0 ? year : year - 399) / 400;
+    int yoe = year - era * 400;
+    int doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+void days_to_date(int days, int *year, int *month, int *day){
+
+    days += 719468;
+    int era = (days >= 0 ? days : days - 146096) / 146097;
+    int doe = days - era * 146097;
+    int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int mp = (5 * doy + 2) / 153;
+    *day = doy - (153 * mp + 2) / 5 + 1;
+    *month = mp < 10 ? mp + 3 : mp - 9;
+    *year = yoe + era * 400 + (*month <= 2);
+}
+
+
+/* Clock functions */
+
+/*
+ * The UTC offset of a zone only changes at a few points in time (DST). Finding the offset needs localtime_r, which
+ * only knows the TZ variable: for a named zone, TZ is switched for the call and then restored, under mutex_clock.
+ * So the offset is cached together with the time it stays valid, up to its next change, in a single atomic word.
+ * The next change is found once, by probing localtime_r a day at a time and then to the minute.
+ * Reading the clock is then time() and an atomic load, and TZ is only switched when a zone is registered
+ * and when its offset changes (or a year has passed without a change).
+ */
+
+// Cache of a zone: the offset is valid in the epoch minutes [from, until)
+static long long pack_offset(long long from, long long until, int offset){
+
+    return (until << 32) | ((until - from) << OFFSET_BITS) | (offset + OFFSET_BIAS);
+}
+
+static int offset_valid(long long cache, long long epoch_minute){
+
+    long long until = (long long)((unsigned long long)cache >> 32);
+    long long span = (cache >> OFFSET_BITS) & ((1 << SPAN_BITS) - 1);
+
+    return epoch_minute >= until - span && epoch_minute < until;
+}
+
+// UTC offset in minutes at an epoch minute, for the current TZ
+static int offset_at(long long epoch_minute){
+
+    struct tm tm;
+    time_t t = (time_t)(epoch_minute * 60);
+
+    localtime_r(&t, &tm);
+    return (int)(tm.tm_gmtoff / 60);
+}
+
+// Compute the offset of a zone at the given time and until when it is valid. Call with mutex_clock locked.
+static long long compute_zone(int zone, time_t now){
+
+    char *old_tz = NULL;
+    long long minute = now / 60;
+    long long horizon = minute + ZONE_HORIZON;
+    long long until = horizon;
+
+    if(zones[zone].name[0] != '\0'){
+        // Switch TZ for the calls, then restore it
+        const char *tz = getenv("TZ");
+        if(tz != NULL && (old_tz = strdup(tz)) == NULL){
+            // TZ could not be restored: keep the last offset for this minute
+            long long cache = atomic_load_explicit(&zones[zone].cache, memory_order_relaxed);
+            int offset = cache != 0 ? (int)(cache & ((1 << OFFSET_BITS) - 1)) - OFFSET_BIAS : 0;
+            return pack_offset(minute, minute + 1, offset);
+        }
+        setenv("TZ", zones[zone].name, 1);
+        tzset();
+    }
+
+    int offset = offset_at(minute);
+
+    // Find the next change: first the day, then the minute
+    for(long long t = minute; t < horizon; t += MINUTES_PER_DAY){
+        long long next = t + MINUTES_PER_DAY < horizon ? t + MINUTES_PER_DAY : horizon;
+        if(offset_at(next) != offset){
+            while(next - t > 1){
+                long long middle = t + (next - t) / 2;
+                if(offset_at(middle) == offset)
+                    t = middle;
+                else
+                    next = middle;
+            }
+            until = next;
+            break;
+        }
+    }
+
+    if(zones[zone].name[0] != '\0'){
+        if(old_tz != NULL)
+            setenv("TZ", old_tz, 1);
+        else
+            unsetenv("TZ");
+        free(old_tz);
+        tzset();
+    }
+
+    return pack_offset(minute, until, offset);
+}
+
+// The offset of a zone changed (or was not computed yet): compute it again
+static long long refresh_zone(int zone, time_t now){
+
+    pthread_mutex_lock(&mutex_clock);
+
+    // Another thread may have refreshed the zone while this one waited for the lock
+    long long cache = atomic_load_explicit(&zones[zone].cache, memory_order_acquire);
+    if(!offset_valid(cache, now / 60)){
+        cache = compute_zone(zone, now);
+        atomic_store_explicit(&zones[zone].cache, cache, memory_order_release);
+    }
+
+    pthread_mutex_unlock(&mutex_clock);
+
+    return cache;
+}
+
+// Return the current local time of a zone, in minutes since 1970-01-01
+static long long zone_minutes(int zone){
+
+    time_t now = wall_clock(NULL);
+    long long cache = atomic_load_explicit(&zones[zone].cache, memory_order_acquire);
+
+    if(!offset_valid(cache, now / 60)){
+        cache = refresh_zone(zone, now);    // the offset changed, or not loaded yet
+    }
+
+    return now / 60 + (cache & ((1 << OFFSET_BITS) - 1)) - OFFSET_BIAS;
+}
+
+// Check that a TZ name has a timezone file (TZif format). localtime_r silently uses UTC for unknown names.
+static int zone_exists(const char *tz_name){
+
+    char path[PATH_MAX];
+    char magic[4];
+    struct stat st;
+    const char *dir = getenv("TZDIR");
+
+    if(dir == NULL || dir[0] == '\0'){
+        dir = ZONEINFO_DIR;
+    }
+    if(tz_name[0] == '/' || strstr(tz_name, "..") != NULL){
+        return 0;
+    }
+    snprintf(path, sizeof(path), "%s/%s", dir, tz_name);
+
+    if(stat(path, &st) != 0 || !S_ISREG(st.st_mode)){
+        return 0;
+    }
+
+    // The zoneinfo directory also holds tables (zone.tab, iso3166.tab, tzdata.zi, ...)
+    FILE *f = fopen(path, "rb");
+    if(f == NULL){
+        return 0;
+    }
+    size_t n = fread(magic, 1, sizeof(magic), f);
+    fclose(f);
+
+    return n == sizeof(magic) && memcmp(magic, "TZif", sizeof(magic)) == 0;
+}
+
+int clock_zone(const char *tz_name){
+
+    if(tz_name == NULL || tz_name[0] == '\0'){
+        return CLOCK_ZONE_LOCAL;
+    }
+    if(strlen(tz_name) >= MAX_ZONE_NAME_LENGTH || !zone_exists(tz_name)){
+        return -1;
+    }
+
+    pthread_mutex_lock(&mutex_clock);
+
+    int n = atomic_load(&num_zones);
+    int zone;
+    for(zone = 1; zone < n; zone++){
+        if(strcmp(zones[zone].name, tz_name) == 0)
+            break;
+    }
+    // Not registered yet, add it if there is space
+    if(zone == n){
+        if(n < MAX_CLOCK_ZONES){
+            strcpy(zones[zone].name, tz_name);
+            atomic_store(&zones[zone].cache, compute_zone(zone, wall_clock(NULL)));
+            atomic_store(&num_zones, n + 1);
+        }
+        else{
+            zone = -1;
+        }
+    }
+
+    pthread_mutex_unlock(&mutex_clock);
+
+    return zone;
+}
+
+const char *clock_zone_name(int zone){
+
+    return zones[zone].name;
+}
+
+int now_in_minutes(int zone){
+
+    long long t_minutes = zone_minutes(zone) % MINUTES_PER_DAY;
+    return (int)(t_minutes < 0 ? t_minutes + MINUTES_PER_DAY : t_minutes);
+}
+
+int today_in_days(int zone){
+
+    long long t_minutes = zone_minutes(zone);
+    return (int)((t_minutes < 0 ? t_minutes - MINUTES_PER_DAY + 1 : t_minutes) / MINUTES_PER_DAY);
+}
+
+void now_in_string(char *time_string, int zone){
 
-    time_t current_time = time(NULL);
-    struct tm *tm = localtime(&current_time);
-    hm_to_string(time_string, tm->tm_hour, tm->tm_min);
+    minutes_to_str(now_in_minutes(zone), time_string);
 }
@@ -8,6 +8,17 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <time.h>
+
+
+#define MAX_CLOCK_ZONES 16              // maximum number of timezones of the real-world clock
+#define CLOCK_ZONE_LOCAL 0              // the local timezone (TZ variable or system default)
+#define MINUTES_PER_DAY 1440
+
+
+/* Global Variables */
+extern time_t (*wall_clock)(time_t *);  // real-world time source of the clock functions and the export, time() by default
+
 
 /* Utility functions */
 
@@ -71,11 +82,70 @@ extern void minutes_to_str(int t_minutes, char *t_string);
 extern int str_to_minutes(const char *t_string);
 
 
+/**
+ * @brief   Convert a calendar date to days since 1970-01-01
+ * @param year  Year
+ * @param month  Month [1,12]
+ * @param day  Day of the month [1,31]
+ * @return  The date in days format
+ */
+extern int date_to_days(int year, int month, int day);
+
+
+/**
+ * @brief   Convert days since 1970-01-01 to a calendar date
+ * @param days  The date in days format
+ * @param year  Year
+ * @param month  Month [1,12]
+ * @param day  Day of the month [1,31]
+ */
+extern void days_to_date(int days, int *year, int *month, int *day);
+
+
+/* Clock functions */
+
+/**
+ * @brief   Register a timezone for the real-world clock
+ * @param tz_name  A TZ name, e.g. "Europe/Athens", or NULL/"" for the local timezone
+ * @return  The zone, for the clock functions below, or -1 if the name is unknown or there is no space for another zone
+ *
+ * Note: the offset of a named zone is found by switching the TZ environment variable and calling localtime_r.
+ * This happens here and in the clock functions, when the offset of a zone changes (DST), and TZ is then restored.
+ * Other threads must not read TZ or call localtime/mktime at the same time.
+ */
+extern int clock_zone(const char *tz_name);
+
+
+/**
+ * @brief   Return the TZ name of a zone
+ * @param zone  A zone returned by clock_zone, or CLOCK_ZONE_LOCAL
+ * @return  The name given to clock_zone, "" for the local timezone
+ */
+extern const char *clock_zone_name(int zone);
+
+
+/**
+ * @brief   Return the real-world time of the day, thread-safe and without locking except when the UTC offset changes
+ * @param zone  A zone returned by clock_zone, or CLOCK_ZONE_LOCAL
+ * @return  Time in minutes format
+ */
+extern int now_in_minutes(int zone);
+
+
+/**
+ * @brief   Return the real-world date in days format
+ * @param zone  A zone returned by clock_zone, or CLOCK_ZONE_LOCAL
+ * @return  Days since 1970-01-01
+ */
+extern int today_in_days(int zone);
+
+
 /**
  * @brief Return real-time "now" in string format "%d%d:%d%d"
  * @param time_string  A string to hold the result
+ * @param zone  A zone returned by clock_zone, or CLOCK_ZONE_LOCAL
  */
-extern void now_in_string(char *time_string);
+extern void now_in_string(char *time_string, int zone);
 
 
 #endif //UTILS_H
@@ -0,0 +1,768 @@
+/**
+ *  @file test_engine.c
+ *  @brief  Deterministic simulation tests of the engine
+ *
+ */
+
+/*
+ * Main ideas:
+ * The engine runs in this thread, one engine_step at a time, on a virtual clock advanced by the test.
+ * User input is a script: lines fed through input_stream when the simulation time reaches a given minute.
+ * Each line is handled like the main loop does, so questions stay open until a later line answers them.
+ * Every printed message is recorded with the simulation time it was printed at and compared to the expected sequence.
+ * Messages still in the printer buffer when the run stops are recorded as UNDELIVERED.
+ * Each scenario is repeated many times, the result must be the same every time.
+ *
+ * Usage: test_engine [scenario] [activities file]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "main.h"
+#include "utils.h"
+#include "history.h"
+#include "export.h"
+
+
+#define REPETITIONS 1000                 // runs of each scenario
+#define MAX_PRINTED 200                 // maximum number of recorded messages per run
+#define MAX_STEPS 10000000              // steps before a run is considered stuck
+#define UNDELIVERED -1                  // time of messages not printed before the end of the day
+
+
+/* Structs */
+typedef struct {
+    /*
+     * A printed message and the simulation time it was printed at
+     */
+    int t;
+    const char *message;
+} Message;
+
+typedef struct {
+    /*
+     * User input: lines fed when the simulation time reaches "at", one after the other
+     */
+    int at;
+    const char *lines;
+    int owner;                      // who types them, SESSION_OWNER_CONSOLE if omitted
+} Input;
+
+typedef struct {
+    /*
+     * Represents a run of one day
+     */
+    int speed_factor;
+    const char *start;              // initial simulation time
+    int until;                      // stop at this simulation time, or at the end of the day
+    long tick_us;                   // virtual clock advance per engine step, in microseconds
+    const Input *inputs;
+    int num_inputs;
+} Day;
+
+
+/* Global Variables */
+const char *agenda;                             // the activities file
+clock_t virtual_clock;                          // the engine time source
+int virtual_date;                               // the engine date source
+time_t virtual_wall_clock;                      // the real-world time source of the clock functions and the export
+char printed[MAX_PRINTED][MAX_STRING_LENGTH];   // messages printed in the current run
+int printed_t[MAX_PRINTED];
+int num_printed;
+
+
+/* Engine dependencies */
+clock_t get_virtual_clock(void){
+
+    return virtual_clock;
+}
+
+time_t get_wall_clock(time_t *t){
+
+    if(t != NULL)
+        *t = virtual_wall_clock;
+    return virtual_wall_clock;
+}
+
+int get_virtual_date(void){
+
+    return virtual_date;
+}
+
+void record_message(const char *message){
+
+    if(num_printed < MAX_PRINTED){
+        strcpy(printed[num_printed], message);
+        printed_t[num_printed] = t_simulation;
+    }
+    num_printed++;
+}
+
+
+/* Harness functions */
+
+/**
+ * @brief  Run one day of the engine (or part of it), recording all messages
+ * @param day  The day to run
+ * @return  0 for success, 1 in case the day did not end
+ */
+int run_day(const Day *day){
+
+    char string[MAX_STRING_LENGTH];
+    int next_input = 0;
+
+    if(load_activities(agenda))
+        return 1;
+
+    speed_factor = day->speed_factor;
+    virtual_clock = 0;
+    num_printed = 0;
+    init_simulation(day->start);
+
+    for(long step = 0; step < MAX_STEPS; step++){
+
+        int end_of_day = engine_step();
+
+        // Feed the scripted input that is due
+        while(next_input < day->num_inputs && t_simulation >= day->inputs[next_input].at){
+            const char *lines = day->inputs[next_input].lines;
+            input_stream = fmemopen((void *)lines, strlen(lines), "r");
+            for(const char *c = lines; *c; c++){
+                if(*c == '\n'){
+                    user_input(string);
+                    handle_query(string, day->inputs[next_input].owner);
+                }
+            }
+            fclose(input_stream);
+            input_stream = NULL;
+            next_input++;
+        }
+
+        if(end_of_day || t_simulation >= day->until){
+            // Whatever is left in the printer buffer is never printed
+            int delivered = num_printed;
+            while(1){
+                print_next();
+                if(num_printed == delivered)
+                    break;
+                printed_t[num_printed - 1] = UNDELIVERED;
+                delivered = num_printed;
+            }
+            return 0;
+        }
+
+        virtual_clock += day->tick_us * CLOCKS_PER_SEC / 1000000;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief  Read a whole text file
+ * @param filename  The file
+ * @param buf  Holds the content
+ * @param size  Size of buf
+ * @return  0 for success, 1 in case the file could not be read
+ */
+int read_file(const char *filename, char *buf, size_t size){
+
+    FILE *f = fopen(filename, "r");
+    if(f == NULL){
+        buf[0] = '\0';
+        return 1;
+    }
+    size_t length = fread(buf, 1, size - 1, f);
+    buf[length] = '\0';
+    fclose(f);
+    return 0;
+}
+
+/**
+ * @brief  Compare the recorded messages to the expected ones. Print both in case of a difference.
+ * @return  0 if equal, 1 otherwise
+ */
+int check_messages(const Message *expected, int num_expected){
+
+    int equal = num_printed == num_expected;
+    for(int i = 0; equal && i < num_expected; i++){
+        equal = printed_t[i] == expected[i].t && strcmp(printed[i], expected[i].message) == 0;
+    }
+    if(equal)
+        return 0;
+
+    printf("Expected %d messages:\n", num_expected);
+    for(int i = 0; i < num_expected; i++){
+        printf("  %5d %s", expected[i].t, expected[i].message);
+    }
+    printf("Printed %d messages:\n", num_printed);
+    for(int i = 0; i < num_printed && i < MAX_PRINTED; i++){
+        printf("  %5d %s", printed_t[i], printed[i]);
+    }
+    return 1;
+}
+
+/**
+ * @brief  Run a day REPETITIONS times, checking the messages of every run
+ * @return  0 for success, 1 for failure
+ */
+int repeat_day(const Day *day, const Message *expected, int num_expected){
+
+    clock_t begin = clock();
+
+    for(int run = 0; run < REPETITIONS; run++){
+        if(run_day(day)){
+            printf("Run %d: the day did not end.\n", run);
+            return 1;
+        }
+        if(check_messages(expected, num_expected)){
+            printf("Run %d: unexpected messages.\n", run);
+            return 1;
+        }
+    }
+
+    printf("%d runs in %.3f secs\n", REPETITIONS, (double)(clock() - begin) / CLOCKS_PER_SEC);
+    return 0;
+}
+
+
+/* Scenarios */
+
+// A full day from midnight, 1 minute per second
+int test_full_day(void){
+
+    static const Day day = {60, "00:00", MINUTES_PER_DAY, 1000000, NULL, 0};
+    static const Message expected[] = {
+        {3, "Activity \"Sleeping\" starts now!\n"},
+        {441, "Activity \"Sleeping\" ends in less than 10 minutes!\n"},
+        {453, "Activity \"Wake Up\" starts now!\n"},
+        {471, "Activity \"Wake Up\" ends in less than 10 minutes!\n"},
+        {483, "Activity \"Breakfast time\" starts now!\n"},
+        {561, "Activity \"Breakfast time\" ends in less than 10 minutes!\n"},
+        {573, "Activity \"Yoga\" starts now!\n"},
+        {651, "Activity \"Yoga\" ends in less than 10 minutes!\n"},
+        {663, "Activity \"Second breakfast\" starts now!\n"},
+        {711, "Activity \"Second breakfast\" ends in less than 10 minutes!\n"},
+        {723, "Activity \"Playing tennis\" starts now!\n"},
+        {831, "Activity \"Playing tennis\" ends in less than 10 minutes!\n"},
+        {843, "Activity \"Lunch\" starts now!\n"},
+        {891, "Activity \"Lunch\" ends in less than 10 minutes!\n"},
+        {903, "Activity \"Siesta time\" starts now!\n"},
+        {1071, "Activity \"Siesta time\" ends in less than 10 minutes!\n"},
+        {1083, "Activity \"Poker with friends\" starts now!\n"},
+        {1191, "Activity \"Poker with friends\" ends in less than 10 minutes!\n"},
+        {1203, "Activity \"TV\" starts now!\n"},
+        {1221, "Activity \"TV\" ends in less than 10 minutes!\n"},
+        {1233, "Activity \"Night Yoga\" starts now!\n"},
+        {1251, "Activity \"Night Yoga\" ends in less than 10 minutes!\n"},
+        {1263, "Activity \"Night prayer\" starts now!\n"},
+        {1311, "Activity \"Night prayer\" ends in less than 10 minutes!\n"},
+        {1323, "Activity \"Sleeping\" starts now!\n"},
+        {UNDELIVERED, "Activity \"Sleeping\" ends in less than 10 minutes!\n"},
+    };
+
+    return repeat_day(&day, expected, sizeof(expected) / sizeof(expected[0]));
+}
+
+// A full day at a speed where the printer cannot keep up: nothing is printed, but nothing is lost or reordered
+int test_extreme_speed(void){
+
+    static const Day day = {100000, "00:00", MINUTES_PER_DAY, 100, NULL, 0};
+    static const Message expected[] = {
+        {UNDELIVERED, "Activity \"Sleeping\" starts now!\n"},
+        {UNDELIVERED, "Activity \"Sleeping\" ends in less than 10 minutes!\n"},
+        {UNDELIVERED, "Activity \"Wake Up\" starts now!\n"},
+        {UNDELIVERED, "Activity \"Wake Up\" ends in less than 10 minutes!\n"},
+        {UNDELIVERED, "Activity \"Breakfast time\" starts now!\n"},
+        {UNDELIVERED, "Activity \"Breakfast time\" ends in less than 10 minutes!\n"},
+        {UNDELIVERED, "Activity \"Yoga\" starts now!\n"},
+        {UNDELIVERED, "Activity \"Yoga\" ends in less than 10 minutes!\n"},
+        {UNDELIVERED, "Activity \"Second breakfast\" starts now!\n"},
+        {UNDELIVERED, "Activity \"Second breakfast\" ends in less than 10 minutes!\n"},
+        {UNDELIVERED, "Activity \"Playing tennis\" starts now!\n"},
+        {UNDELIVERED, "Activity \"Playing tennis\" ends in less than 10 minutes!\n"},
+        {UNDELIVERED, "Activity \"Lunch\" starts now!\n"},
+        {UNDELIVERED, "Activity \"Lunch\" ends in less than 10 minutes!\n"},
+        {UNDELIVERED, "Activity \"Siesta time\" starts now!\n"},
+        {UNDELIVERED, "Activity \"Siesta time\" ends in less than 10 minutes!\n"},
+        {UNDELIVERED, "Activity \"Poker with friends\" starts now!\n"},
+        {UNDELIVERED, "Activity \"Poker with friends\" ends in less than 10 minutes!\n"},
+        {UNDELIVERED, "Activity \"TV\" starts now!\n"},
+        {UNDELIVERED, "Activity \"TV\" ends in less than 10 minutes!\n"},
+        {UNDELIVERED, "Activity \"Night Yoga\" starts now!\n"},
+        {UNDELIVERED, "Activity \"Night Yoga\" ends in less than 10 minutes!\n"},
+        {UNDELIVERED, "Activity \"Night prayer\" starts now!\n"},
+        {UNDELIVERED, "Activity \"Night prayer\" ends in less than 10 minutes!\n"},
+        {UNDELIVERED, "Activity \"Sleeping\" starts now!\n"},
+        {UNDELIVERED, "Activity \"Sleeping\" ends in less than 10 minutes!\n"},
+    };
+
+    return repeat_day(&day, expected, sizeof(expected) / sizeof(expected[0]));
+}
+
+// Queries during the morning: marking done, asking again, "now" and invalid input
+int test_queries(void){
+
+    static const Input inputs[] = {
+        {455, "07:40\nyes\n"},
+        {480, "now\nno\n"},
+        {500, "7:45\n"},
+        {510, "25:00\n"},
+        {520, "12:00\nno\n"},
+    };
+    static const Day day = {60, "07:30", 600, 1000000, inputs, sizeof(inputs) / sizeof(inputs[0])};
+    static const Message expected[] = {
+        {453, "Activity \"Wake Up\" starts now!\n"},
+        {458, "Wake Up (07:30 - 07:59)\n"},
+        {461, "Activity \"Wake Up\" is not done yet.\nShould I check this activity as done? (yes/no)\n"},
+        {464, "Activity \"Wake Up\" marked as done! \n"},
+        {480, "08:00\n"},
+        {483, "Activity \"Breakfast time\" starts now!\n"},
+        {486, "Breakfast time (08:00 - 09:29)\n"},
+        {489, "Activity \"Breakfast time\" is not done yet.\nShould I check this activity as done? (yes/no)\n"},
+        {492, "Status of \"Breakfast time\" remained: undone. \n"},
+        {503, "Wake Up (07:30 - 07:59)\n"},
+        {506, "Chill, you already did \"Wake Up\".\n"},
+        {513, "Invalid input: 1 day = [0,23] hours, 1 hour = [0,59] minutes. Please try again.\n"},
+        {523, "Playing tennis (12:00 - 13:59)\n"},
+        {526, "Activity \"Playing tennis\" is not done yet.\nShould I check this activity as done? (yes/no)\n"},
+        {529, "Status of \"Playing tennis\" remained: undone. \n"},
+        {562, "Activity \"Breakfast time\" ends in less than 10 minutes!\n"},
+        {571, "Activity \"Yoga\" starts now!\n"},
+    };
+
+    return repeat_day(&day, expected, sizeof(expected) / sizeof(expected[0]));
+}
+
+// Several questions open at once, answered later in the order they were asked. Other input, even "now", is not an answer.
+int test_pending_questions(void){
+
+    static const Input inputs[] = {
+        {455, "07:40\n"},
+        {460, "12:00\n"},
+        {465, "07:50\n"},
+        {467, "now\n"},
+        {468, "nothing\n"},
+        {470, "yes\n"},
+        {475, "no\n"},
+        {480, "yes\n"},
+    };
+    static const Day day = {60, "07:30", 530, 1000000, inputs, sizeof(inputs) / sizeof(inputs[0])};
+    static const Message expected[] = {
+        {453, "Activity \"Wake Up\" starts now!\n"},
+        {458, "Wake Up (07:30 - 07:59)\n"},
+        {463, "Activity \"Wake Up\" is not done yet.\nShould I check this activity as done? (yes/no)\n"},
+        {467, "07:47\n"},
+        {473, "Playing tennis (12:00 - 13:59)\n"},
+        {478, "Activity \"Playing tennis\" is not done yet. I will ask after you answer about \"Wake Up\" (yes/no).\n"},
+        {483, "Wake Up (07:30 - 07:59)\n"},
+        {486, "Activity \"Wake Up\" is not done yet. I already asked, please answer with yes or no.\n"},
+        {489, "Wake Up (07:30 - 07:59)\n"},
+        {492, "Activity \"Wake Up\" is not done yet. I already asked, please answer with yes or no.\n"},
+        {495, "Invalid input! Please try again.\n"},
+        {498, "Activity \"Wake Up\" ends in less than 10 minutes!\n"},
+        {501, "Activity \"Wake Up\" marked as done! \n"},
+        {504, "Activity \"Playing tennis\" is not done yet.\nShould I check this activity as done? (yes/no)\n"},
+        {507, "Status of \"Playing tennis\" remained: undone. \n"},
+        {510, "Activity \"Breakfast time\" starts now!\n"},
+        {513, "Invalid input! Please try again.\n"},
+    };
+
+    return repeat_day(&day, expected, sizeof(expected) / sizeof(expected[0]));
+}
+
+// Questions of two clients: each one's answers only go to the questions asked to them
+int test_question_owners(void){
+
+    static const Input inputs[] = {
+        {455, "07:40\n", 1},
+        {460, "yes\n"},
+        {465, "12:00\n"},
+        {470, "yes\n", 1},
+        {475, "no\n"},
+        {480, "no\n", 1},
+    };
+    static const Day day = {60, "07:30", 500, 1000000, inputs, sizeof(inputs) / sizeof(inputs[0])};
+    static const Message expected[] = {
+        {453, "Activity \"Wake Up\" starts now!\n"},
+        {458, "Wake Up (07:30 - 07:59)\n"},
+        {463, "Activity \"Wake Up\" is not done yet.\nShould I check this activity as done? (yes/no)\n"},
+        {468, "Invalid input! Please try again.\n"},
+        {473, "Playing tennis (12:00 - 13:59)\n"},
+        {478, "Activity \"Playing tennis\" is not done yet.\nShould I check this activity as done? (yes/no)\n"},
+        {483, "Activity \"Wake Up\" ends in less than 10 minutes!\n"},
+        {486, "Activity \"Wake Up\" marked as done! \n"},
+        {489, "Status of \"Playing tennis\" remained: undone. \n"},
+        {492, "Activity \"Breakfast time\" starts now!\n"},
+        {495, "Invalid input! Please try again.\n"},
+    };
+
+    return repeat_day(&day, expected, sizeof(expected) / sizeof(expected[0]));
+}
+
+// Three days in a row and a restart on the third, saved and reported like the program does on exit
+int test_multi_day(void){
+
+    static const Input inputs_1[] = {{490, "08:10\nyes\n"}};
+    static const Input inputs_3[] = {{880, "14:30\nyes\n"}, {890, "21:00\nyes\n"}};
+    static const Day days[] = {
+        {60, "00:00", MINUTES_PER_DAY, 1000000, inputs_1, 1},
+        {60, "00:00", MINUTES_PER_DAY, 1000000, NULL, 0},
+        {60, "00:00", MINUTES_PER_DAY, 1000000, inputs_3, 2},
+        {60, "12:00", MINUTES_PER_DAY, 1000000, NULL, 0},
+    };
+    static const int dates[] = {20000, 20001, 20002, 20002};
+    static const char expected_history[] =
+        "day 20000\n0 449 -1 Sleeping\n450 479 -1 Wake Up\n480 569 490 Breakfast time\n570 659 -1 Yoga\n"
+        "660 719 -1 Second breakfast\n720 839 -1 Playing tennis\n840 899 -1 Lunch\n900 1079 -1 Siesta time\n"
+        "1080 1199 -1 Poker with friends\n1200 1229 -1 TV\n1230 1259 -1 Night Yoga\n1260 1319 -1 Night prayer\n"
+        "1320 1439 -1 Sleeping\n"
+        "day 20001\n0 449 -1 Sleeping\n450 479 -1 Wake Up\n480 569 -1 Breakfast time\n570 659 -1 Yoga\n"
+        "660 719 -1 Second breakfast\n720 839 -1 Playing tennis\n840 899 -1 Lunch\n900 1079 -1 Siesta time\n"
+        "1080 1199 -1 Poker with friends\n1200 1229 -1 TV\n1230 1259 -1 Night Yoga\n1260 1319 -1 Night prayer\n"
+        "1320 1439 -1 Sleeping\n"
+        "day 20002\n0 449 -1 Sleeping\n450 479 -1 Wake Up\n480 569 -1 Breakfast time\n570 659 -1 Yoga\n"
+        "660 719 -1 Second breakfast\n720 839 -1 Playing tennis\n840 899 880 Lunch\n900 1079 -1 Siesta time\n"
+        "1080 1199 -1 Poker with friends\n1200 1229 -1 TV\n1230 1259 -1 Night Yoga\n1260 1319 890 Night prayer\n"
+        "1320 1439 -1 Sleeping\n"
+        "day 20002\n0 449 -1 Sleeping\n450 479 -1 Wake Up\n480 569 -1 Breakfast time\n570 659 -1 Yoga\n"
+        "660 719 -1 Second breakfast\n720 839 -1 Playing tennis\n840 899 -1 Lunch\n900 1079 -1 Siesta time\n"
+        "1080 1199 -1 Poker with friends\n1200 1229 -1 TV\n1230 1259 -1 Night Yoga\n1260 1319 -1 Night prayer\n"
+        "1320 1439 -1 Sleeping\n";
+    static const char expected_report[] =
+        "Activity                        Slots   Done    Rate   Avg lateness  Longest  Current\n"
+        "Sleeping                            6      0    0.0%              -        0        0\n"
+        "Wake Up                             3      0    0.0%              -        0        0\n"
+        "Breakfast time                      3      1   33.3%      -79.0 min        1        0\n"
+        "Yoga                                3      0    0.0%              -        0        0\n"
+        "Second breakfast                    3      0    0.0%              -        0        0\n"
+        "Playing tennis                      3      0    0.0%              -        0        0\n"
+        "Lunch                               3      1   33.3%      -19.0 min        1        1\n"
+        "Siesta time                         3      0    0.0%              -        0        0\n"
+        "Poker with friends                  3      0    0.0%              -        0        0\n"
+        "TV                                  3      0    0.0%              -        0        0\n"
+        "Night Yoga                          3      0    0.0%              -        0        0\n"
+        "Night prayer                        3      1   33.3%     -429.0 min        1        1\n";
+
+    char base[] = "/tmp/grandmagenda_XXXXXX";
+    char history_file[sizeof(base) + 8];
+    char history[sizeof(expected_history) + MAX_STRING_LENGTH];
+    char report[sizeof(expected_report) + 4096];
+    int ret = 0;
+    clock_t begin = clock();
+
+    int fd = mkstemp(base);
+    if(fd == -1){
+        printf("Could not create a temporary file.\n");
+        return 1;
+    }
+    close(fd);
+    strcpy(agenda_file, base);          // save_status writes to agenda_file + ".history"
+    snprintf(history_file, sizeof(history_file), "%s.history", base);
+    engine_date = get_virtual_date;
+
+    for(int run = 0; run < REPETITIONS && ret == 0; run++){
+        remove(history_file);
+
+        for(int d = 0; d < 4; d++){
+            virtual_date = dates[d];
+            if(run_day(&days[d])){
+                printf("Run %d: day %d did not end.\n", run, d);
+                ret = 1;
+                break;
+            }
+            save_status();
+        }
+        if(ret)
+            break;
+
+        if(read_file(history_file, history, sizeof(history)) || strcmp(history, expected_history) != 0){
+            printf("Run %d: unexpected history:\n%s", run, history);
+            ret = 1;
+            break;
+        }
+
+        // The report, as printed by "GrandmAgenda report"
+        FILE *f = fmemopen(report, sizeof(report), "w");
+        print_report(f, history_file);
+        fclose(f);
+
+        if(strcmp(report, expected_report) != 0){
+            printf("Run %d: unexpected report:\n%s", run, report);
+            ret = 1;
+        }
+    }
+
+    remove(history_file);
+    remove(base);
+    if(ret == 0)
+        printf("%d runs in %.3f secs\n", REPETITIONS, (double)(clock() - begin) / CLOCKS_PER_SEC);
+    return ret;
+}
+
+// Export of special characters, a long description and an activity ending at midnight, byte by byte
+int test_export(void){
+
+    static const Activity agenda_activities[] = {
+        {done, undone, 0, 1379, 1379, "Say \"hi\" to C:\\Users\tand wave"},
+        {undone, undone, 1380, 1438, 0, "Tea, biscuits; cards \\ dominoes, and a chat with the neighbours about the garden"},
+        {undone, undone, 1439, 1439, 0, "Sleep"},
+    };
+    static const char expected_json[] =
+        "{\"date\":\"2024-12-31\",\"start\":\"00:00\",\"end\":\"22:59\","
+        "\"description\":\"Say \\\"hi\\\" to C:\\\\Users\\u0009and wave\",\"status\":\"done\"}\n"
+        "{\"date\":\"2024-12-31\",\"start\":\"23:00\",\"end\":\"23:58\","
+        "\"description\":\"Tea, biscuits; cards \\\\ dominoes, and a chat with the neighbours about the garden\",\"status\":\"undone\"}\n"
+        "{\"date\":\"2024-12-31\",\"start\":\"23:59\",\"end\":\"23:59\",\"description\":\"Sleep\",\"status\":\"undone\"}\n"
+        "{\"date\":\"2025-01-01\",\"start\":\"00:00\",\"end\":\"22:59\","
+        "\"description\":\"Say \\\"hi\\\" to C:\\\\Users\\u0009and wave\",\"status\":\"undone\"}\n"
+        "{\"date\":\"2025-01-01\",\"start\":\"23:00\",\"end\":\"23:58\","
+        "\"description\":\"Tea, biscuits; cards \\\\ dominoes, and a chat with the neighbours about the garden\",\"status\":\"undone\"}\n"
+        "{\"date\":\"2025-01-01\",\"start\":\"23:59\",\"end\":\"23:59\",\"description\":\"Sleep\",\"status\":\"undone\"}\n";
+    static const char expected_ics[] =
+        "BEGIN:VCALENDAR\r\nVERSION:2.0\r\nPRODID:-//GrandmAgenda//EN\r\n"
+        "BEGIN:VEVENT\r\nUID:20241231T000000-da38dc85@grandmagenda\r\nDTSTAMP:20231114T221320Z\r\n"
+        "DTSTART:20241231T000000\r\nDTEND:20241231T230000\r\n"
+        "SUMMARY:Say \"hi\" to C:\\\\Users\tand wave\r\nX-GRANDMAGENDA-STATUS:done\r\nEND:VEVENT\r\n"
+        "BEGIN:VEVENT\r\nUID:20241231T230000-da38dc85@grandmagenda\r\nDTSTAMP:20231114T221320Z\r\n"
+        "DTSTART:20241231T230000\r\nDTEND:20241231T235900\r\n"
+        "SUMMARY:Tea\\, biscuits\\; cards \\\\ dominoes\\, and a chat with the neighbo\r\n"     // 72 octets
+        " urs about the garden\r\nX-GRANDMAGENDA-STATUS:undone\r\nEND:VEVENT\r\n"
+        "BEGIN:VEVENT\r\nUID:20241231T235900-da38dc85@grandmagenda\r\nDTSTAMP:20231114T221320Z\r\n"
+        "DTSTART:20241231T235900\r\nDTEND:20250101T000000\r\n"                                         // ends at midnight
+        "SUMMARY:Sleep\r\nX-GRANDMAGENDA-STATUS:undone\r\nEND:VEVENT\r\n"
+        "END:VCALENDAR\r\n";
+    static const char expected_ics_zone[] =
+        "BEGIN:VCALENDAR\r\nVERSION:2.0\r\nPRODID:-//GrandmAgenda//EN\r\n"
+        "BEGIN:VEVENT\r\nUID:20241231T235900-da38dc85@grandmagenda\r\nDTSTAMP:20231114T221320Z\r\n"
+        "DTSTART;TZID=Europe/Athens:20241231T235900\r\nDTEND;TZID=Europe/Athens:20250101T000000\r\n"
+        "SUMMARY:Sleep\r\nX-GRANDMAGENDA-STATUS:undone\r\nEND:VEVENT\r\n"
+        "END:VCALENDAR\r\n";
+
+    static char output[8192];
+    int first_day = date_to_days(2024, 12, 31);
+    int ret = 0;
+
+    memcpy(activities, agenda_activities, sizeof(agenda_activities));
+    num_activities = sizeof(agenda_activities) / sizeof(agenda_activities[0]);
+    virtual_wall_clock = 1700000000;    // 2023-11-14 22:13:20 UTC
+    wall_clock = get_wall_clock;
+
+    for(int run = 0; run < REPETITIONS && ret == 0; run++){
+        FILE *f = fmemopen(output, sizeof(output), "w");
+        if(export_activities(f, export_json, "grandma.txt", NULL, first_day, 2)){
+            printf("Run %d: JSON export failed.\n", run);
+            ret = 1;
+        }
+        fclose(f);
+        if(strcmp(output, expected_json) != 0){
+            printf("Run %d: unexpected JSON export:\n%s", run, output);
+            ret = 1;
+            break;
+        }
+
+        f = fmemopen(output, sizeof(output), "w");
+        if(export_activities(f, export_ics, "grandma.txt", NULL, first_day, 1)){
+            printf("Run %d: iCalendar export failed.\n", run);
+            ret = 1;
+        }
+        fclose(f);
+        if(strcmp(output, expected_ics) != 0){
+            printf("Run %d: unexpected iCalendar export:\n%s", run, output);
+            ret = 1;
+            break;
+        }
+    }
+
+    // In a timezone, only the last activity
+    activities[0] = agenda_activities[2];
+    num_activities = 1;
+    FILE *f = fmemopen(output, sizeof(output), "w");
+    if(export_activities(f, export_ics, "grandma.txt", "Europe/Athens", first_day, 1)){
+        printf("iCalendar export in a timezone failed.\n");
+        ret = 1;
+    }
+    fclose(f);
+    if(strcmp(output, expected_ics_zone) != 0){
+        printf("Unexpected iCalendar export in a timezone:\n%s", output);
+        ret = 1;
+    }
+
+    return ret;
+}
+
+
+// Write a timezone file (TZif version 1) with a single change of the UTC offset, in minutes
+int write_tzif(const char *filename, time_t change, int before, int after){
+
+    unsigned char data[44 + 4 + 1 + 2 * 6 + 8];
+    unsigned char *p = data;
+    const int counts[] = {0, 0, 0, 1, 2, 8};        // isut, isstd, leap, transitions, types, designation chars
+    const long values[] = {(long)change, before * 60L, after * 60L};
+
+    memset(data, 0, sizeof(data));
+    memcpy(p, "TZif", 4);
+    p += 20;                                        // version 1 and reserved
+    for(int i = 0; i < 6; i++, p += 4){
+        p[3] = (unsigned char)counts[i];
+    }
+    for(int i = 0; i < 3; i++){
+        unsigned long v = (unsigned long)values[i];
+        unsigned char *q = (i == 0) ? p : p + 5 + 6 * (i - 1);     // transition time, then the offset of each type
+        q[0] = (unsigned char)(v >> 24);
+        q[1] = (unsigned char)(v >> 16);
+        q[2] = (unsigned char)(v >> 8);
+        q[3] = (unsigned char)v;
+    }
+    p[4] = 1;                                       // the transition changes to type 1
+    p[5 + 6 + 4] = 1;                               // type 1 is DST
+    p[5 + 6 + 5] = 4;                               // designation index of type 1
+    memcpy(p + 5 + 12, "AAA\0BBB", 8);
+
+    FILE *f = fopen(filename, "wb");
+    if(f == NULL)
+        return 1;
+    size_t n = fwrite(data, 1, sizeof(data), f);
+    return (fclose(f) != 0) | (n != sizeof(data));
+}
+
+// Check the real-world time and date of a zone
+int check_clock(const char *when, int zone, int expected_time, int expected_day){
+
+    char time_string[6];
+    char expected[6];
+
+    now_in_string(time_string, zone);
+    minutes_to_str(expected_time, expected);
+    if(strcmp(time_string, expected) != 0 || today_in_days(zone) != expected_day){
+        printf("%s, zone %d: %s day %d instead of %s day %d.\n",
+               when, zone, time_string, today_in_days(zone), expected, expected_day);
+        return 1;
+    }
+    return 0;
+}
+
+// Timezones from a fixture directory: unknown names, day rollover across zones, cached offset up to its change
+int test_clock(void){
+
+    const time_t change = 1743296400;               // 2025-03-30 01:00 UTC, the zone goes from +01:00 to +02:00
+    const int day = 20176;                          // 2025-03-29
+    char dir[] = "/tmp/grandmagenda_XXXXXX";
+    char zone_file[sizeof(dir) + 16];
+    char table_file[sizeof(dir) + 16];
+    int zone;
+    int ret = 0;
+
+    if(mkdtemp(dir) == NULL){
+        printf("Could not create a temporary directory.\n");
+        return 1;
+    }
+    snprintf(zone_file, sizeof(zone_file), "%s/Testland", dir);
+    snprintf(table_file, sizeof(table_file), "%s/zone.tab", dir);
+    FILE *f = fopen(table_file, "w");
+    if(f == NULL || write_tzif(zone_file, change, 60, 120)){
+        printf("Could not write the timezone files.\n");
+        return 1;
+    }
+    fputs("# country code, coordinates, TZ\nXX\t+0000+00000\tTestland\n", f);
+    fclose(f);
+
+    setenv("TZDIR", dir, 1);
+    setenv("TZ", "UTC0", 1);                        // the local zone
+    tzset();
+    wall_clock = get_wall_clock;
+
+    // Unknown names and files that are not timezones
+    if(clock_zone("Nowhere") != -1 || clock_zone("zone.tab") != -1 || clock_zone("../Testland") != -1){
+        printf("An unknown timezone was accepted.\n");
+        ret = 1;
+    }
+
+    // Registered before the change: the offset is cached until then
+    virtual_wall_clock = change - 150 * 60;         // 22:30 UTC
+    zone = clock_zone("Testland");
+    if(zone <= CLOCK_ZONE_LOCAL){
+        printf("Timezone \"Testland\" was rejected.\n");
+        ret = 1;
+    }
+    ret |= check_clock("22:30 UTC", CLOCK_ZONE_LOCAL, 22 * 60 + 30, day);
+    ret |= check_clock("22:30 UTC", zone, 23 * 60 + 30, day);
+
+    // The next day comes an hour earlier in the zone
+    virtual_wall_clock = change - 90 * 60;          // 23:30 UTC
+    ret |= check_clock("23:30 UTC", CLOCK_ZONE_LOCAL, 23 * 60 + 30, day);
+    ret |= check_clock("23:30 UTC", zone, 30, day + 1);
+
+    // Up to the change the file is not read again: without it, the zone would fall back to UTC
+    remove(zone_file);
+    virtual_wall_clock = change - 60;               // 00:59 UTC
+    ret |= check_clock("00:59 UTC, no file", zone, 60 + 59, day + 1);
+    if(strcmp(getenv("TZ"), "UTC0") != 0){
+        printf("TZ was not restored.\n");
+        ret = 1;
+    }
+
+    // At the change the offset is computed again, and then cached for the next year
+    write_tzif(zone_file, change, 60, 120);
+    virtual_wall_clock = change;                    // 01:00 UTC
+    ret |= check_clock("01:00 UTC", zone, 3 * 60, day + 1);
+    remove(zone_file);
+    virtual_wall_clock = change + 200 * 86400;
+    ret |= check_clock("200 days later, no file", zone, 3 * 60, day + 201);
+
+    // Back before the change
+    write_tzif(zone_file, change, 60, 120);
+    virtual_wall_clock = change - 30 * 60;          // 00:30 UTC
+    ret |= check_clock("back to 00:30 UTC", zone, 60 + 30, day + 1);
+    if(strcmp(getenv("TZ"), "UTC0") != 0){
+        printf("TZ was not restored.\n");
+        ret = 1;
+    }
+
+    remove(zone_file);
+    remove(table_file);
+    rmdir(dir);
+    return ret;
+}
+
+
+int main(int argc, char *argv[]){
+
+    static const struct {
+        const char *name;
+        int (*run)(void);
+    } tests[] = {
+        {"full_day", test_full_day},
+        {"extreme_speed", test_extreme_speed},
+        {"queries", test_queries},
+        {"pending_questions", test_pending_questions},
+        {"question_owners", test_question_owners},
+        {"multi_day", test_multi_day},
+        {"export", test_export},
+        {"clock", test_clock},
+    };
+
+    if(argc != 3){
+        printf("Please supply the following arguments:\n"
+               " 1.scenario 2.full text filepath of the activities\n");
+        return EXIT_FAILURE;
+    }
+    agenda = argv[2];
+
+    // Run the engine on the virtual clock, record instead of printing
+    engine_clock = get_virtual_clock;
+    printer_output = record_message;
+
+    for(size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++){
+        if(strcmp(argv[1], tests[i].name) == 0){
+            return tests[i].run() ? EXIT_FAILURE : EXIT_SUCCESS;
+        }
+    }
+
+    printf("Unknown scenario \"%s\".\n", argv[1]);
+    return EXIT_FAILURE;
+}